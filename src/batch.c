@@ -0,0 +1,225 @@
+#include "batch.h"
+#include "kernels.h"
+#include "fixed.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+
+/* PLAY MATCH
+ * Steps a match between random bots until someone wins or max_ticks pass
+ * Every decision comes from the game's own RNG, so a match only depends on its starting state
+ */
+
+void play_match(GameState *game, long max_ticks, MatchResult *result) {
+  int winner = 0;
+  long ticks = 0;
+
+  while (ticks < max_ticks && !winner) {
+    for (int p = 0; p < game->n_players; p++) {
+      uint64_t r = next_random(&game->rng);
+      if (r % 16 == 0) {
+        player_action(game, p, (r >> 8) % 4);
+      }
+    }
+
+    update_physics(game, 1);
+    winner = check_winner(game);
+    ticks++;
+  }
+
+  *result = (MatchResult){winner, ticks, game->players[0].score, game->players[1].score};
+}
+
+
+/* A worker's share of the match numbers still to play, packed as lo << 32 | hi
+ * The owner claims from the front, thieves take the back half, both with a single compare and swap
+ * Padded out to its own cache line so workers don't slow each other down
+ */
+typedef struct WorkRange {
+  _Atomic uint64_t range;
+  char pad[64 - sizeof(uint64_t)];
+} WorkRange;
+
+typedef struct Worker {
+  pthread_t thread;
+  int id;
+  const BatchConfig *config;
+  WorkRange *ranges;
+  MatchResult *results;
+  long ticks;
+} Worker;
+
+static uint64_t pack_range(uint64_t lo, uint64_t hi) {
+  return lo << 32 | hi;
+}
+
+// Claims the next match from a worker's own range, returns -1 once it is empty
+static long take(WorkRange *own) {
+  uint64_t range = atomic_load(&own->range);
+  while (true) {
+    uint64_t lo = range >> 32, hi = range & 0xFFFFFFFF;
+    if (lo >= hi) { return -1; }
+    if (atomic_compare_exchange_weak(&own->range, &range, pack_range(lo+1, hi))) { return lo; }
+  }
+}
+
+// Moves the back half of another worker's range into our own (empty) one, returns false if it had nothing to spare
+static int steal(WorkRange *victim, WorkRange *own) {
+  uint64_t range = atomic_load(&victim->range);
+  while (true) {
+    uint64_t lo = range >> 32, hi = range & 0xFFFFFFFF;
+    if (lo >= hi) { return false; }
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (atomic_compare_exchange_weak(&victim->range, &range, pack_range(lo, mid))) {
+      atomic_store(&own->range, pack_range(mid, hi));
+      return true;
+    }
+  }
+}
+
+static void *worker_main(void *arg) {
+  Worker *worker = arg;
+  const BatchConfig *config = worker->config;
+  WorkRange *own = &worker->ranges[worker->id];
+
+  while (true) {
+    long match = take(own);
+
+    // Out of our own work, go round the others once looking for some, and stop if nobody has any left
+    if (match < 0) {
+      int stolen = false;
+      for (int k = 1; k < config->threads && !stolen; k++) {
+        stolen = steal(&worker->ranges[(worker->id + k) % config->threads], own);
+      }
+      if (!stolen) { break; }
+      continue;
+    }
+
+    GameState game;
+    new_game(&game, config->n_players);
+    game.rng = config->seed;
+    game.rng ^= next_random(&(uint64_t){(uint64_t)match});
+    if (config->fixed_point) { use_fixed_point(&game); }
+
+    play_match(&game, config->max_ticks, &worker->results[match]);
+    worker->ticks += worker->results[match].ticks;
+  }
+
+  free_physics_scratch();
+  return NULL;
+}
+
+static int compare_long(const void *a, const void *b) {
+  long x = *(const long *)a, y = *(const long *)b;
+  return (x > y) - (x < y);
+}
+
+
+/* RUN BATCH
+ * Plays config->matches independent matches spread over config->threads worker threads
+ * Each worker starts with an even slice of the match numbers and steals from the others when it runs dry
+ * Results go straight into results[match], so there is no shared lock, and the totals are added up at the end
+ */
+
+int run_batch(const BatchConfig *config, MatchResult *results, BatchStats *stats) {
+  if (config->matches <= 0 || config->matches > 0xFFFFFFFFL || config->threads <= 0) {
+    return -1;
+  }
+
+  WorkRange *ranges = aligned_alloc(64, config->threads * sizeof(WorkRange));
+  Worker *workers = calloc(config->threads, sizeof(Worker));
+
+  for (int t = 0; t < config->threads; t++) {
+    atomic_init(&ranges[t].range, pack_range(config->matches * t / config->threads, config->matches * (t+1) / config->threads));
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (int t = 0; t < config->threads; t++) {
+    workers[t] = (Worker){0, t, config, ranges, results, 0};
+    pthread_create(&workers[t].thread, NULL, worker_main, &workers[t]);
+  }
+
+  *stats = (BatchStats){0};
+  for (int t = 0; t < config->threads; t++) {
+    pthread_join(workers[t].thread, NULL);
+    stats->ticks += workers[t].ticks;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  stats->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  stats->matches = config->matches;
+
+  long *ticks = malloc(config->matches * sizeof(long));
+  for (long m = 0; m < config->matches; m++) {
+    switch (results[m].winner) {
+      case 0:  stats->no_winner++;  break;
+      case 1:  stats->p1_wins++;    break;
+      case 2:  stats->p2_wins++;    break;
+      default: stats->other_wins++; break;
+    }
+
+    int bucket = 0;
+    while (bucket < TICK_BUCKETS-1 && results[m].ticks >= 2L << bucket) { bucket++; }
+    stats->histogram[bucket]++;
+    ticks[m] = results[m].ticks;
+  }
+
+  qsort(ticks, config->matches, sizeof(long), compare_long);
+  stats->p50 = ticks[(config->matches-1) * 50 / 100];
+  stats->p90 = ticks[(config->matches-1) * 90 / 100];
+  stats->p99 = ticks[(config->matches-1) * 99 / 100];
+  stats->max = ticks[config->matches-1];
+
+  free(ticks);
+  free(workers);
+  free(ranges);
+  return 0;
+}
+
+
+/* BATCH MAIN
+ * Usage: spacewar --batch N [--threads T] [--seed S] [--ticks MAX] [--ships N] [--fixed]
+ * Plays N random bot matches on every core and reports throughput and how long matches lasted
+ */
+
+int batch_main(int argc, char *argv[]) {
+  BatchConfig config = {1000, sysconf(_SC_NPROCESSORS_ONLN), 5L * 60 * TICK_RATE, 2, 1, false};
+
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i+1 < argc)    { config.threads = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc)  { config.seed = strtoull(argv[++i], NULL, 10); }
+    else if (strcmp(argv[i], "--ticks") == 0 && i+1 < argc) { config.max_ticks = atol(argv[++i]); }
+    else if (strcmp(argv[i], "--ships") == 0 && i+1 < argc) { config.n_players = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--fixed") == 0)               { config.fixed_point = true; }
+    else { config.matches = atol(argv[i]); }
+  }
+
+  if (config.n_players < 2 || config.n_players > MAX_PLAYERS) {
+    fprintf(stderr, "--ships must be between 2 and %d\n", MAX_PLAYERS);
+    return 1;
+  }
+
+  MatchResult *results = malloc(config.matches * sizeof(MatchResult));
+  BatchStats stats;
+  if (!results || run_batch(&config, results, &stats)) {
+    fprintf(stderr, "bad batch size or thread count\n");
+    free(results);
+    return 1;
+  }
+
+  printf("%ld matches on %d threads in %.3fs, %.1f matches/s, %.0f ticks/s\n",
+    stats.matches, config.threads, stats.seconds, stats.matches / stats.seconds, stats.ticks / stats.seconds);
+  printf("winners: P1 %ld, P2 %ld, other %ld, none %ld\n", stats.p1_wins, stats.p2_wins, stats.other_wins, stats.no_winner);
+  printf("ticks per match: p50 %ld, p90 %ld, p99 %ld, max %ld\n", stats.p50, stats.p90, stats.p99, stats.max);
+
+  for (int b = 0; b < TICK_BUCKETS; b++) {
+    if (stats.histogram[b]) {
+      printf("  %7ld - %-7ld %ld\n", b ? 1L << b : 0, (2L << b) - 1, stats.histogram[b]);
+    }
+  }
+
+  free(results);
+  return 0;
+}
@@ -0,0 +1,37 @@
+#include "game.h"
+
+#ifndef BATCH_H
+#define BATCH_H
+
+// Tick counts are histogrammed in powers of two, bucket b holds matches lasting [2^b, 2^(b+1)) ticks
+#define TICK_BUCKETS 20
+
+typedef struct BatchConfig {
+  long matches;
+  int threads;
+  long max_ticks;
+  int n_players;
+  uint64_t seed;
+  int fixed_point;
+} BatchConfig;
+
+// Winner is 0 when a match hit max_ticks without anyone winning
+typedef struct MatchResult {
+  int winner;
+  long ticks;
+  int score1, score2;
+} MatchResult;
+
+typedef struct BatchStats {
+  double seconds;
+  long matches, ticks;
+  long no_winner, p1_wins, p2_wins, other_wins;
+  long histogram[TICK_BUCKETS];
+  long p50, p90, p99, max;
+} BatchStats;
+
+void play_match(GameState *game, long max_ticks, MatchResult *result);
+int run_batch(const BatchConfig *config, MatchResult *results, BatchStats *stats);
+int batch_main(int argc, char *argv[]);
+
+#endif
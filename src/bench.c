@@ -0,0 +1,379 @@
+#include "bench.h"
+#include "batch.h"
+#include "sched.h"
+#include "kernels.h"
+#include <fcntl.h>
+
+// Results of the micro benchmarks go here so the compiler can't throw the work away
+static volatile double sink;
+
+
+/* MICRO BENCHMARKS
+ * The small helpers every tick leans on, each on its own with inputs that change every call
+ */
+
+static long bench_thrust_vector(void *ctx, long n) {
+  (void)ctx;
+  double sum = 0;
+  for (long i = 0; i < n; i++) {
+    sum += thrust_vector(i & 7, i & 8 ? Y : X);
+  }
+  sink = sum;
+  return n;
+}
+
+static long bench_shift_trails(void *ctx, long n) {
+  (void)ctx;
+  ObjectData data = new_objectdata(10, 10);
+  for (long i = 0; i < n; i++) {
+    data.y += 0.25;
+    shift_trails(&data);
+  }
+  sink = data.y3;
+  return n;
+}
+
+static long bench_total_vel(void *ctx, long n) {
+  (void)ctx;
+  ObjectData data = new_objectdata(10, 10);
+  double sum = 0;
+  for (long i = 0; i < n; i++) {
+    data.vely = (i & 15) * 0.0625;
+    data.velx = (i & 7) * 0.125;
+    sum += total_vel(data);
+  }
+  sink = sum;
+  return n;
+}
+
+
+/* SCENARIOS
+ * Whole ticks and frames: a plain duel, a long match between random bots, a crowded orbit with everything pulling
+ * on everything, a swarm of torpedoes, and drawing the game into a terminal that nobody is looking at
+ */
+
+static GameState scenario;
+
+static void setup_duel(void *ctx) {
+  (void)ctx;
+  new_game(&scenario, 2);
+}
+
+static long bench_update_physics(void *ctx, long n) {
+  (void)ctx;
+  for (long i = 0; i < n; i++) {
+    update_physics(&scenario, 1);
+  }
+  return n;
+}
+
+// The same stream of matches every sample, each seeded from its number like --batch does
+static long match_seed;
+
+static void setup_matches(void *ctx) {
+  (void)ctx;
+  match_seed = 0;
+}
+
+static long bench_match(void *ctx, long n) {
+  (void)ctx;
+  long ticks = 0;
+  while (ticks < n) {
+    new_game(&scenario, 2);
+    scenario.rng = ++match_seed;
+    MatchResult result;
+    play_match(&scenario, 5*60*TICK_RATE, &result);
+    ticks += result.ticks;
+  }
+  return ticks;
+}
+
+// Everyone turns and fires a lot, so the torpedo table stays full of things feeling and adding gravity
+static long bench_orbit(void *ctx, long n) {
+  (void)ctx;
+  for (long i = 0; i < n; i++) {
+    for (int p = 0; p < scenario.n_players; p++) {
+      uint64_t r = next_random(&scenario.rng);
+      if (r % 4 == 0) {
+        player_action(&scenario, p, (r >> 8) % 4);
+      }
+    }
+    update_physics(&scenario, 1);
+  }
+  return n;
+}
+
+// The orbit is timed once it has filled up, from a copy taken then so the warm up isn't paid for every sample
+static GameState orbit_start;
+
+static void setup_orbit(void *ctx) {
+  (void)ctx;
+  if (orbit_start.n_players == 0) {
+    new_game(&scenario, 20);
+    add_wells(&scenario, 32, 0.5);
+    scenario.ship_mass = 0.05;
+    scenario.torpedo_gravity = true;
+    scenario.rng = 1;
+    bench_orbit(NULL, 4*TICK_RATE);
+    copy_state(&orbit_start, &scenario);
+  }
+  copy_state(&scenario, &orbit_start);
+}
+
+
+/* 64 ships spread over a big arena, each firing every tick it can and turning as it goes, keep the torpedo pool full
+ * with thousands of live torpedoes and dozens fired and spent every tick. Timed from a copy once it has filled, like the orbit
+ */
+static GameState swarm_start;
+
+static long bench_swarm(void *ctx, long n) {
+  (void)ctx;
+  for (long i = 0; i < n; i++) {
+    for (int p = 0; p < scenario.n_players; p++) {
+      player_action(&scenario, p, FIRE);
+      if (next_random(&scenario.rng) % 4 == 0) { player_action(&scenario, p, LEFT); }
+    }
+    update_physics(&scenario, 1);
+  }
+  return n;
+}
+
+static void setup_swarm(void *ctx) {
+  (void)ctx;
+  if (swarm_start.n_players == 0) {
+    new_game(&scenario, MAX_PLAYERS);
+    resize_arena(&scenario, 8*ARENA_H, 8*ARENA_W);
+    scenario.torpedo_limit = MAX_BULLETS;
+    scenario.rng = 1;
+    bench_swarm(NULL, 2*BULLET_FUSE);
+    copy_state(&swarm_start, &scenario);
+  }
+  copy_state(&scenario, &swarm_start);
+}
+
+
+// A second of a busy match, drawn over and over into an ANSI terminal writing to /dev/null
+#define DRAW_FRAMES TICK_RATE
+
+typedef struct DrawBench {
+  BenchDraw draw;
+  Term term;
+  Surface win, ui1, ui2;
+  Hud hud1, hud2;
+  ArenaView view;
+  Camera cam;
+  GameState frames[DRAW_FRAMES];
+} DrawBench;
+
+static int open_draw(DrawBench *bench, BenchDraw draw) {
+  int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  if (fd < 0 || term_open(&bench->term, fd, -1) < 0) {
+    return -1;
+  }
+  bench->draw = draw;
+  term_resize(&bench->term, WIN_H + 9, 200);
+
+  int scrh = bench->term.h, scrw = bench->term.w;
+  bench->win = new_surface(&bench->term, WIN_H, WIN_W, (scrh-WIN_H)/2, (scrw-WIN_W)/2);
+  bench->ui1 = new_surface(&bench->term, UI_SIZE-2, UI_SIZE, (scrh-WIN_H)/2, (scrw-UI_SIZE)/2-69);
+  bench->ui2 = new_surface(&bench->term, UI_SIZE-2, UI_SIZE, (scrh-WIN_H)/2, (scrw-UI_SIZE)/2+69);
+  surf_colour(&bench->win, 1);
+  surf_colour(&bench->ui1, 1);
+  surf_colour(&bench->ui2, 1);
+  view_init(&bench->view, &bench->win, WIN_H, WIN_W);
+  hud_init(&bench->hud1, &bench->ui1, 1);
+  hud_init(&bench->hud2, &bench->ui2, 2);
+  bench->cam = (Camera){ .mode = CAM_BOTH };
+
+  setup_orbit(NULL);
+  for (int t = 0; t < DRAW_FRAMES; t++) {
+    bench_orbit(NULL, 1);
+    copy_state(&bench->frames[t], &scenario);
+  }
+  return 0;
+}
+
+static void close_draw(DrawBench *bench) {
+  view_free(&bench->view);
+  int fd = bench->term.out_fd;
+  term_close(&bench->term);
+  close(fd);
+}
+
+static void setup_draw(void *ctx) {
+  DrawBench *bench = ctx;
+  view_invalidate(&bench->view);
+  hud_invalidate(&bench->hud1);
+  hud_invalidate(&bench->hud2);
+}
+
+static long bench_draw(void *ctx, long n) {
+  DrawBench *bench = ctx;
+  for (long i = 0; i < n; i++) {
+    bench->draw(&bench->view, &bench->cam, &bench->hud1, &bench->hud2, &bench->frames[i % DRAW_FRAMES]);
+    surf_present(&bench->win);
+  }
+  return n;
+}
+
+// The same frame over and over, like the frames a fast screen draws between ticks, where nothing has moved
+static long bench_draw_still(void *ctx, long n) {
+  DrawBench *bench = ctx;
+  for (long i = 0; i < n; i++) {
+    bench->draw(&bench->view, &bench->cam, &bench->hud1, &bench->hud2, &bench->frames[0]);
+    surf_present(&bench->win);
+  }
+  return n;
+}
+
+
+static int by_value(const void *p, const void *q) {
+  double a = *(const double *)p, b = *(const double *)q;
+  return (a > b) - (a < b);
+}
+
+/* MEASURE
+ * Grows the operation count until one run takes about BENCH_SAMPLE_NS (unless the benchmark fixes it), then times
+ * BENCH_SAMPLES runs of that size
+ */
+
+static BenchResult measure(const Bench *bench) {
+  long n = 1;
+  while (!bench->ops) {
+    if (bench->setup) { bench->setup(bench->ctx); }
+    long long start = now_ns();
+    bench->run(bench->ctx, n);
+    long long took = now_ns() - start;
+    if (took >= BENCH_SAMPLE_NS / 8) {
+      n = n * (double)BENCH_SAMPLE_NS / took + 1;
+      break;
+    }
+    n *= 2;
+  }
+
+  if (bench->ops) { n = bench->ops; }
+
+  double ns[BENCH_SAMPLES];
+  long ops = 0;
+  for (int s = 0; s < BENCH_SAMPLES; s++) {
+    if (bench->setup) { bench->setup(bench->ctx); }
+    long long start = now_ns();
+    long done = bench->run(bench->ctx, n);
+    ns[s] = (double)(now_ns() - start) / done;
+    ops += done;
+  }
+  qsort(ns, BENCH_SAMPLES, sizeof(double), by_value);
+  return (BenchResult){ bench->name, ns[BENCH_SAMPLES/2], ns[0], ops };
+}
+
+
+/* Looks a benchmark's best time up in a results file from an earlier run, returns false if it isn't there (or there is no file)
+ * Runs are compared on their best sample rather than the median, since other work on the machine can only slow a sample
+ */
+static int baseline_of(FILE *baseline, const char *name, double *ns) {
+  if (!baseline) { return false; }
+  rewind(baseline);
+
+  char line[256], found[64];
+  double median, best;
+  while (fgets(line, sizeof line, baseline)) {
+    if (line[0] == '#') { continue; }
+    if (sscanf(line, "%63s %lf %lf", found, &median, &best) == 3 && strcmp(found, name) == 0) {
+      *ns = best;
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/* BENCH MAIN
+ * Usage: spacewar --bench [--out FILE] [--baseline FILE] [--threshold PCT] [--only NAME]
+ * Runs every benchmark (or those whose name contains NAME), prints each one's time per operation and writes them
+ * as tab separated name, median ns, best ns and operations timed. Against a baseline (an earlier --out file) each
+ * best time is also given its change, and anything more than PCT percent slower (default 10) is flagged and makes
+ * it exit 1
+ */
+
+int bench_main(int argc, char *argv[], BenchDraw draw) {
+  const char *out_path = NULL;
+  const char *baseline_path = NULL;
+  const char *only = NULL;
+  double threshold = BENCH_THRESHOLD;
+
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--out") == 0 && i+1 < argc) { out_path = argv[++i]; }
+    else if (strcmp(argv[i], "--baseline") == 0 && i+1 < argc) { baseline_path = argv[++i]; }
+    else if (strcmp(argv[i], "--threshold") == 0 && i+1 < argc) { threshold = atof(argv[++i]); }
+    else if (strcmp(argv[i], "--only") == 0 && i+1 < argc) { only = argv[++i]; }
+  }
+
+  FILE *baseline = baseline_path ? fopen(baseline_path, "r") : NULL;
+  if (baseline_path && !baseline) {
+    printf("no baseline at %s yet, nothing to compare against\n", baseline_path);
+  }
+
+  static DrawBench drawing;
+  if (open_draw(&drawing, draw) < 0) {
+    fprintf(stderr, "couldn't set up the drawing benchmark\n");
+    return 1;
+  }
+
+  const Bench benches[] = {
+    { "thrust_vector", NULL, bench_thrust_vector, NULL, 0 },
+    { "shift_trails", NULL, bench_shift_trails, NULL, 0 },
+    { "total_vel", NULL, bench_total_vel, NULL, 0 },
+    { "update_physics", setup_duel, bench_update_physics, NULL, 3000 },
+    { "headless_match", setup_matches, bench_match, NULL, 20000 },
+    { "gravity_orbit", setup_orbit, bench_orbit, NULL, 500 },
+    { "torpedo_swarm", setup_swarm, bench_swarm, NULL, 300 },
+    { "update_screen", setup_draw, bench_draw, &drawing, 1000 },
+    { "screen_still", setup_draw, bench_draw_still, &drawing, 1000 },
+  };
+  int n_benches = sizeof benches / sizeof benches[0];
+
+  BenchResult results[sizeof benches / sizeof benches[0]];
+  int n_results = 0;
+  int regressions = 0;
+
+  printf("%-16s %12s %12s %12s %12s\n", "benchmark", "median ns", "best ns", "baseline", "change");
+  for (int b = 0; b < n_benches; b++) {
+    if (only && !strstr(benches[b].name, only)) { continue; }
+    BenchResult result = measure(&benches[b]);
+    results[n_results++] = result;
+
+    double base;
+    if (baseline_of(baseline, result.name, &base)) {
+      double change = (result.min_ns / base - 1) * 100;
+      int regressed = change > threshold;
+      regressions += regressed;
+      printf("%-16s %12.2f %12.2f %12.2f %+11.1f%%%s\n", result.name, result.ns, result.min_ns, base, change, regressed ? "  REGRESSED" : "");
+    }
+    else {
+      printf("%-16s %12.2f %12.2f %12s %12s\n", result.name, result.ns, result.min_ns, "-", "-");
+    }
+    fflush(stdout);
+  }
+  close_draw(&drawing);
+  if (baseline) { fclose(baseline); }
+
+  if (out_path) {
+    FILE *out = fopen(out_path, "w");
+    if (!out) {
+      perror(out_path);
+      return 1;
+    }
+    fprintf(out, "# spacewar --bench, %s kernels, median and best of %d samples\n", get_kernels()->name, BENCH_SAMPLES);
+    fprintf(out, "# name\tns_per_op\tbest_ns\tops\n");
+    for (int r = 0; r < n_results; r++) {
+      fprintf(out, "%s\t%.3f\t%.3f\t%ld\n", results[r].name, results[r].ns, results[r].min_ns, results[r].ops);
+    }
+    fclose(out);
+  }
+
+  if (regressions) {
+    printf("%d benchmark%s more than %.0f%% slower than the baseline\n", regressions, regressions == 1 ? "" : "s", threshold);
+    return 1;
+  }
+  return 0;
+}
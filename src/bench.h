@@ -0,0 +1,39 @@
+#include "hud.h"
+
+#ifndef BENCH_H
+#define BENCH_H
+
+// Each benchmark is timed this many times and the median is reported, so one unlucky sample can't move it
+#define BENCH_SAMPLES 9
+
+// Roughly how long each sample runs for, the operation count is scaled up until a sample takes at least this
+#define BENCH_SAMPLE_NS 20000000LL
+
+// Slower than the baseline by more than this many percent counts as a regression
+#define BENCH_THRESHOLD 10.0
+
+// Draws a frame the way the game does, update_screen() lives with the rest of the screen code in main.c
+typedef void (*BenchDraw)(ArenaView *view, Camera *cam, Hud *hud1, Hud *hud2, GameState *game);
+
+/* One benchmark: run() does at least n operations on ctx and returns how many it really did
+ * setup() (if there is one) puts ctx back to its starting point before each sample
+ * A scenario whose cost changes as it plays out sets ops, so every sample (and every run) times the same stretch of it
+ */
+typedef struct Bench {
+  const char *name;
+  void (*setup)(void *ctx);
+  long (*run)(void *ctx, long n);
+  void *ctx;
+  long ops;
+} Bench;
+
+// What a benchmark came to, in nanoseconds per operation
+typedef struct BenchResult {
+  const char *name;
+  double ns, min_ns;
+  long ops;
+} BenchResult;
+
+int bench_main(int argc, char *argv[], BenchDraw draw);
+
+#endif
@@ -0,0 +1,229 @@
+#include "bot.h"
+#include "sched.h"
+
+
+/* ROLLOUT
+ * Plays one future out from root: the bot's first action, then everyone (the bot included) acting at random
+ * like the batch bots do, for BOT_HORIZON ticks. Scores the bot's points against its best opponent's, as -1 to 1
+ * sim is reused for every rollout, so nothing is allocated once the physics scratch space has grown
+ */
+
+static double rollout(int p, const GameState *root, GameState *sim, int first, uint64_t *rng) {
+  copy_state(sim, root);
+  if (first) { player_action(sim, p, first-1); }
+
+  for (int t = 0; t < BOT_HORIZON; t++) {
+    for (int q = 0; q < sim->n_players; q++) {
+      uint64_t r = next_random(rng);
+      if ((q != p || t > 0) && r % 16 == 0) {
+        player_action(sim, q, (r >> 8) % 4);
+      }
+    }
+    update_physics(sim, 1);
+  }
+
+  int best = INT_MIN;
+  for (int q = 0; q < sim->n_players; q++) {
+    int gain = sim->players[q].score - root->players[q].score;
+    if (q != p && gain > best) { best = gain; }
+  }
+  double value = (sim->players[p].score - root->players[p].score - best) / 300.0;
+  return value > 1 ? 1 : value < -1 ? -1 : value;
+}
+
+// UCB1 over the first action, anything not yet tried goes first
+static int choose(const BotStats *stats, long total) {
+  int best = 0;
+  double best_score = -INFINITY;
+  for (int a = 0; a < BOT_ACTIONS; a++) {
+    if (stats->visits[a] == 0) { return a; }
+    double score = stats->value[a] / stats->visits[a] + sqrt(2 * log((double)total) / stats->visits[a]);
+    if (score > best_score) {
+      best_score = score;
+      best = a;
+    }
+  }
+  return best;
+}
+
+// The most tried first action, the one the search trusts most, with ties going to doing nothing
+static int most_visited(const BotStats *stats) {
+  int best = 0;
+  for (int a = 1; a < BOT_ACTIONS; a++) {
+    if (stats->visits[a] > stats->visits[best]) { best = a; }
+  }
+  return best;
+}
+
+
+/* BOT WORKER
+ * Waits for a new state, searches it with rollouts until the deadline, then adds what it found to the shared stats
+ * Every worker searches on its own and only touches the shared stats once per decision, the last one in decides
+ * A search overtaken by a newer post is thrown away rather than merged
+ */
+
+static void *bot_worker(void *arg) {
+  BotWorker *worker = arg;
+  Bot *bot = worker->bot;
+  GameState *root = &worker->root, *sim = &worker->sim;
+  uint64_t rng = (uint64_t)worker->id * 0x9E3779B97F4A7C15ull + 1;
+  long seen = 0;
+
+  pthread_mutex_lock(&bot->lock);
+  while (true) {
+    while (!bot->quit && bot->generation == seen) {
+      pthread_cond_wait(&bot->wake, &bot->lock);
+    }
+    if (bot->quit) { break; }
+    seen = bot->generation;
+    copy_state(root, &bot->root);
+    long long deadline = bot->deadline;
+    pthread_mutex_unlock(&bot->lock);
+
+    BotStats stats = {0};
+    long total = 0;
+    while (total < BOT_ACTIONS || now_ns() < deadline) {
+      int a = choose(&stats, total);
+      stats.value[a] += rollout(bot->player, root, sim, a, &rng);
+      stats.visits[a]++;
+      total++;
+    }
+
+    pthread_mutex_lock(&bot->lock);
+    if (seen == bot->generation) {
+      for (int a = 0; a < BOT_ACTIONS; a++) {
+        bot->stats.visits[a] += stats.visits[a];
+        bot->stats.value[a] += stats.value[a];
+      }
+      bot->rollouts += total;
+      if (--bot->searching == 0) {
+        bot->decision = most_visited(&bot->stats);
+        bot->decided = seen;
+        bot->decisions++;
+        pthread_cond_broadcast(&bot->done);
+      }
+    }
+  }
+  pthread_mutex_unlock(&bot->lock);
+
+  free_physics_scratch();
+  return NULL;
+}
+
+
+// Starts the bot's worker threads for a player, who then waits for bot_post()
+int bot_start(Bot *bot, int player, int n_threads, int budget_ms) {
+  if (n_threads < 1 || budget_ms < 1) {
+    fprintf(stderr, "the bot needs at least 1 thread and 1ms\n");
+    return -1;
+  }
+
+  bot->workers = calloc(n_threads, sizeof(BotWorker));
+  if (!bot->workers) {
+    fprintf(stderr, "not enough memory for %d bot threads\n", n_threads);
+    return -1;
+  }
+  bot->player = player;
+  bot->n_threads = n_threads;
+  bot->budget = budget_ms * 1000000LL;
+  bot->generation = bot->decided = 0;
+  bot->searching = 0;
+  bot->decision = 0;
+  bot->quit = false;
+  bot->decisions = bot->rollouts = 0;
+  pthread_mutex_init(&bot->lock, NULL);
+  pthread_cond_init(&bot->wake, NULL);
+  pthread_cond_init(&bot->done, NULL);
+
+  for (int t = 0; t < n_threads; t++) {
+    bot->workers[t].bot = bot;
+    bot->workers[t].id = t;
+    pthread_create(&bot->workers[t].thread, NULL, bot_worker, &bot->workers[t]);
+  }
+  return 0;
+}
+
+void bot_stop(Bot *bot) {
+  pthread_mutex_lock(&bot->lock);
+  bot->quit = true;
+  pthread_cond_broadcast(&bot->wake);
+  pthread_mutex_unlock(&bot->lock);
+
+  for (int t = 0; t < bot->n_threads; t++) {
+    pthread_join(bot->workers[t].thread, NULL);
+  }
+  free(bot->workers);
+  pthread_cond_destroy(&bot->wake);
+  pthread_cond_destroy(&bot->done);
+  pthread_mutex_destroy(&bot->lock);
+}
+
+
+// Hands the workers a new state to think about, costs the caller one copy and never waits for them
+void bot_post(Bot *bot, const GameState *game) {
+  pthread_mutex_lock(&bot->lock);
+  copy_state(&bot->root, game);
+  bot->generation++;
+  bot->deadline = now_ns() + bot->budget;
+  bot->searching = bot->n_threads;
+  bot->stats = (BotStats){0};
+  pthread_cond_broadcast(&bot->wake);
+  pthread_mutex_unlock(&bot->lock);
+}
+
+// Takes the decision for the latest post if it is ready, as an enum Action, or -1 for nothing (yet)
+int bot_poll(Bot *bot) {
+  pthread_mutex_lock(&bot->lock);
+  int decision = bot->decided == bot->generation ? bot->decision : 0;
+  bot->decision = 0;
+  pthread_mutex_unlock(&bot->lock);
+  return decision - 1;
+}
+
+// Posts a state and waits for the decision on it, for headless runs where there is no frame to keep to
+int bot_think(Bot *bot, const GameState *game) {
+  bot_post(bot, game);
+  pthread_mutex_lock(&bot->lock);
+  while (bot->decided != bot->generation) {
+    pthread_cond_wait(&bot->done, &bot->lock);
+  }
+  int decision = bot->decision;
+  bot->decision = 0;
+  pthread_mutex_unlock(&bot->lock);
+  return decision - 1;
+}
+
+// The key for an action on the bot's ship, so it goes through the same input path (and replays) as a person's would
+int bot_key(Bot *bot, int action) {
+  static const int keys[2][4] = {
+    { 'w', 'a', 'd', 's' },
+    { KEY_UP, KEY_LEFT, KEY_RIGHT, KEY_DOWN },
+  };
+  return keys[bot->player][action];
+}
+
+// Swaps any keys for the bot's ship out of a tick's ERR terminated keys for a decision, if there is one and room for it
+static void swap_keys(Bot *bot, int keys[], int decision) {
+  enum Action action;
+  int kept = 0;
+  for (int i = 0; i < 7 && keys[i] != ERR; i++) {
+    if (key_action(keys[i], &action) != bot->player) { keys[kept++] = keys[i]; }
+  }
+  if (decision >= 0 && kept < 7) { keys[kept++] = bot_key(bot, decision); }
+  keys[kept] = ERR;
+}
+
+// Puts the bot's latest decision in a tick's keys in place of any for its ship
+void bot_keys(Bot *bot, int keys[]) {
+  swap_keys(bot, keys, bot_poll(bot));
+}
+
+// The same for headless runs, where when think is set it waits for a decision on game rather than taking the latest
+void bot_think_keys(Bot *bot, const GameState *game, int keys[], int think) {
+  swap_keys(bot, keys, think ? bot_think(bot, game) : -1);
+}
+
+void bot_report(Bot *bot, FILE *out) {
+  fprintf(out, "bot: %ld decisions, %.1f rollouts each on %d threads (%dms budget)\n",
+    bot->decisions, bot->decisions ? (double)bot->rollouts / bot->decisions : 0, bot->n_threads, (int)(bot->budget / 1000000));
+}
@@ -0,0 +1,62 @@
+#include "game.h"
+#include <pthread.h>
+
+#ifndef BOT_H
+#define BOT_H
+
+// Choices at each decision: do nothing, or one of the four enum Action values (stored as action+1)
+#define BOT_ACTIONS 5
+
+// The bot decides every BOT_EVERY ticks, and each rollout plays BOT_HORIZON ticks ahead
+#define BOT_EVERY 5
+#define BOT_HORIZON 100
+
+// Default thinking time per decision, well inside the BOT_EVERY ticks it has before the next one
+#define BOT_BUDGET_MS 10
+
+// How often each first action was tried and the total of what it led to, values are between -1 and 1
+typedef struct BotStats {
+  long visits[BOT_ACTIONS];
+  double value[BOT_ACTIONS];
+} BotStats;
+
+// One search thread, with the two states it plays rollouts through, allocated once when the bot starts
+typedef struct BotWorker {
+  pthread_t thread;
+  struct Bot *bot;
+  int id;
+  GameState root, sim;
+} BotWorker;
+
+/* A computer player, searching with rollouts through the real update_physics() on worker threads
+ * The game posts a state and carries on, the workers search it until the deadline and leave a decision behind
+ * root, stats and decision are shared and guarded by lock, everything a worker simulates is its own
+ */
+typedef struct Bot {
+  int player;
+  int n_threads;
+  long long budget;
+  BotWorker *workers;
+  pthread_mutex_t lock;
+  pthread_cond_t wake, done;
+  GameState root;
+  long generation, decided;
+  long long deadline;
+  int searching;
+  BotStats stats;
+  int decision;
+  int quit;
+  long decisions, rollouts;
+} Bot;
+
+int bot_start(Bot *bot, int player, int n_threads, int budget_ms);
+void bot_stop(Bot *bot);
+void bot_post(Bot *bot, const GameState *game);
+int bot_poll(Bot *bot);
+int bot_think(Bot *bot, const GameState *game);
+int bot_key(Bot *bot, int action);
+void bot_keys(Bot *bot, int keys[]);
+void bot_think_keys(Bot *bot, const GameState *game, int keys[], int think);
+void bot_report(Bot *bot, FILE *out);
+
+#endif
@@ -0,0 +1,191 @@
+#include "cast.h"
+#include "replay.h"
+#include "sched.h"
+#include <fcntl.h>
+
+
+static void cast_flush(CastWriter *cast) {
+  const char *bytes = cast->buf;
+  size_t len = cast->len;
+  while (len > 0 && !cast->failed) {
+    ssize_t done = write(cast->fd, bytes, len);
+    if (done <= 0) { cast->failed = true; }
+    else {
+      bytes += done;
+      len -= done;
+    }
+  }
+  cast->bytes += cast->len;
+  cast->len = 0;
+}
+
+// Room for at least n more bytes in the buffer, flushing it if it doesn't have them
+static char *cast_reserve(CastWriter *cast, size_t n) {
+  if (cast->len + n > CAST_BUFFER) { cast_flush(cast); }
+  return cast->buf + cast->len;
+}
+
+static void cast_printf(CastWriter *cast, const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  char *out = cast_reserve(cast, 256);
+  int len = vsnprintf(out, 256, fmt, args);
+  va_end(args);
+  cast->len += len < 256 ? len : 255;
+}
+
+
+/* CAST OPEN
+ * Creates an asciicast v2 file for a screen of h x w, and writes its header line
+ * Returns -1 if the file couldn't be created
+ */
+
+int cast_open(CastWriter *cast, const char *path, int h, int w) {
+  *cast = (CastWriter){0};
+  cast->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (cast->fd < 0) {
+    perror(path);
+    return -1;
+  }
+  cast->buf = malloc(CAST_BUFFER);
+  cast_printf(cast, "{\"version\":2,\"width\":%d,\"height\":%d,\"timestamp\":%lld,\"env\":{\"TERM\":\"xterm-256color\"}}\n",
+              w, h, (long long)time(NULL));
+  return 0;
+}
+
+/* One output event at time seconds into the cast, the bytes JSON escaped on their way into the buffer
+ * Escape sequences are almost all there is to escape, so control characters get the short \u form and UTF-8 passes through
+ */
+void cast_event(CastWriter *cast, double time, const char *data, size_t len) {
+  cast_printf(cast, "[%.6f,\"o\",\"", time);
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = data[i];
+    char *out = cast_reserve(cast, 6);
+    if (c == '"' || c == '\\') {
+      out[0] = '\\';
+      out[1] = c;
+      cast->len += 2;
+    }
+    else if (c < 0x20) {
+      cast->len += snprintf(out, 7, "\\u%04x", c);
+    }
+    else {
+      out[0] = c;
+      cast->len += 1;
+    }
+  }
+  cast_printf(cast, "\"]\n");
+  cast->events++;
+}
+
+// Writes out whatever is still buffered, returns -1 if any of the file failed to write
+int cast_close(CastWriter *cast) {
+  cast_flush(cast);
+  if (close(cast->fd) != 0) { cast->failed = true; }
+  free(cast->buf);
+  return cast->failed ? -1 : 0;
+}
+
+
+/* CAST MAIN
+ * Usage: spacewar --cast REPLAY OUT [--from TICK] [--to TICK] [--fps N] [--camera both|1|2]
+ * Plays a replay as fast as it simulates, drawing it with the game's own screen code into a screen in memory,
+ * and writes the result to OUT as an asciicast v2 recording that asciinema (or its web player) plays back
+ * Frames are taken N times a second of game time (default FRAMERATE), each one only the cells that changed,
+ * and frames where nothing changed aren't written at all, so a quiet stretch costs next to nothing
+ * A headless match can be cast by running it with --record first
+ */
+
+int cast_main(int argc, char *argv[], CastScreen screen) {
+  const char *path = NULL;
+  const char *out_path = NULL;
+  long from = -1;
+  long to = -1;
+  int fps = FRAMERATE;
+  int camera = CAM_BOTH;
+
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--from") == 0 && i+1 < argc)     { from = atol(argv[++i]); }
+    else if (strcmp(argv[i], "--to") == 0 && i+1 < argc)  { to = atol(argv[++i]); }
+    else if (strcmp(argv[i], "--fps") == 0 && i+1 < argc) { fps = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--camera") == 0 && i+1 < argc) {
+      i++;
+      camera = strcmp(argv[i], "1") == 0 ? CAM_P1 : strcmp(argv[i], "2") == 0 ? CAM_P2 : CAM_BOTH;
+    }
+    else if (!path) { path = argv[i]; }
+    else { out_path = argv[i]; }
+  }
+  if (!path || !out_path) {
+    fprintf(stderr, "usage: spacewar --cast REPLAY OUT [--from TICK] [--to TICK] [--fps N] [--camera both|1|2]\n");
+    return 1;
+  }
+  if (fps < 1 || fps > TICK_RATE) {
+    fprintf(stderr, "--fps must be between 1 and %d, frames are only taken on ticks\n", TICK_RATE);
+    return 1;
+  }
+
+  static Replay replay;
+  if (replay_open(&replay, path) < 0) {
+    return 1;
+  }
+  if (from >= 0) {
+    replay_seek(&replay, from);
+  }
+
+  CastWriter cast;
+  if (cast_open(&cast, out_path, CAST_ROWS, CAST_COLS) < 0) {
+    replay_close(&replay);
+    return 1;
+  }
+
+  // Laid out the way open_display() does on a screen just big enough for it
+  Term term;
+  term_open_memory(&term, CAST_ROWS, CAST_COLS);
+  Surface win = new_surface(&term, WIN_H, WIN_W, 0, (CAST_COLS-WIN_W)/2);
+  Surface ui1 = new_surface(&term, UI_SIZE-2, UI_SIZE, 0, (CAST_COLS-UI_SIZE)/2-69);
+  Surface ui2 = new_surface(&term, UI_SIZE-2, UI_SIZE, 0, (CAST_COLS-UI_SIZE)/2+69);
+  surf_colour(&win, 1);
+  surf_colour(&ui1, 1);
+  surf_colour(&ui2, 1);
+  ArenaView view;
+  view_init(&view, &win, WIN_H, WIN_W);
+  Camera cam = (Camera){ .mode = camera };
+  Hud hud1, hud2;
+  hud_init(&hud1, &ui1, 1);
+  hud_init(&hud2, &ui2, 2);
+  screen.hud(&hud1);
+  screen.hud(&hud2);
+
+  long frames = 0, merged = 0;
+  long first = replay.game.tick;
+  long long start = now_ns();
+  int more = true;
+  while (more) {
+    more = (to < 0 || replay.game.tick < to) && replay.game.tick < replay.end_tick;
+
+    // Frame f is the first tick at or after f/fps seconds in, and the last tick always gets one to end on
+    long tick = replay.game.tick - first;
+    if (tick * fps >= frames * TICK_RATE || !more) {
+      screen.frame(&view, &cam, &hud1, &hud2, &replay.game);
+      size_t len = term_diff(&term);
+      if (len) { cast_event(&cast, (double)tick / TICK_RATE, term.out, len); }
+      else { merged++; }
+      frames++;
+    }
+    if (more) { replay_step(&replay); }
+  }
+  double seconds = (now_ns() - start) / 1e9;
+  double game_seconds = (double)(replay.game.tick - first) / TICK_RATE;
+
+  int status = cast_close(&cast);
+  if (status < 0) { fprintf(stderr, "%s: couldn't write all of it\n", out_path); }
+  printf("%s: %.1fs of game time in %.3fs (%.0fx real time)\n", out_path, game_seconds, seconds, game_seconds / seconds);
+  printf("frames %ld, %ld unchanged and merged, %ld events, %zu bytes\n", frames, merged, cast.events, cast.bytes);
+  if (replay.desyncs) { printf("replay drifted from %ld of its snapshots\n", replay.desyncs); }
+
+  view_free(&view);
+  term_close(&term);
+  replay_close(&replay);
+  free_physics_scratch();
+  return status < 0 || replay.desyncs ? 1 : 0;
+}
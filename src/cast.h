@@ -0,0 +1,36 @@
+#include "hud.h"
+
+#ifndef CAST_H
+#define CAST_H
+
+// Events are collected here and written out a buffer at a time, so a long match costs a handful of write()s
+#define CAST_BUFFER (1 << 20)
+
+// The whole screen the game lays itself out on: the arena window with a HUD either side
+#define CAST_ROWS WIN_H
+#define CAST_COLS (UI_SIZE + 2*69)
+
+/* The game's own drawing, which lives with the rest of the screen code in main.c
+ * hud is create_ui(), the parts of a HUD that never change, and frame is update_screen()
+ */
+typedef struct CastScreen {
+  void (*hud)(Hud *hud);
+  void (*frame)(ArenaView *view, Camera *cam, Hud *hud1, Hud *hud2, GameState *game);
+} CastScreen;
+
+// An asciicast v2 file being written, each frame's changes to the screen are one output event
+typedef struct CastWriter {
+  int fd;
+  char *buf;
+  size_t len;
+  long events;
+  size_t bytes;
+  int failed;
+} CastWriter;
+
+int cast_open(CastWriter *cast, const char *path, int h, int w);
+void cast_event(CastWriter *cast, double time, const char *data, size_t len);
+int cast_close(CastWriter *cast);
+int cast_main(int argc, char *argv[], CastScreen screen);
+
+#endif
@@ -0,0 +1,187 @@
+#include "checkpoint.h"
+#include "serial.h"
+#include "replay.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CKPT_MAGIC "SWCK"
+#define CKPT_VERSION 1
+#define HEADER_SIZE 24
+
+// A slot is the checksum, the sequence number and the length of the packed state, then the state itself
+#define SLOT_HEADER 24
+
+
+static size_t round_up(size_t n, size_t to) {
+  return (n + to-1) / to * to;
+}
+
+/* The header is the magic, this format's version, the version of pack_state() inside it (the same as the replay
+ * format's, which changes with it), two spare bytes, then where the slots start and how big each one is
+ * Everything is little endian, so a checkpoint moves between machines like a replay does
+ */
+static int read_header(const unsigned char *map, size_t size, size_t *slot_offset, size_t *slot_size) {
+  if (size < HEADER_SIZE || memcmp(map, CKPT_MAGIC, 4) != 0 || map[4] != CKPT_VERSION || map[5] != REPLAY_VERSION) {
+    return -1;
+  }
+  Reader in = { map+8, map+HEADER_SIZE, false };
+  *slot_offset = get_u64(&in);
+  *slot_size = get_u64(&in);
+  if (*slot_offset < HEADER_SIZE || *slot_size < SLOT_HEADER + STATE_MAX_BYTES || *slot_offset + 2 * *slot_size > size) {
+    return -1;
+  }
+  return 0;
+}
+
+// The slot with the highest sequence number whose checksum holds, or NULL if neither does
+static const unsigned char *newest_slot(const unsigned char *map, size_t slot_offset, size_t slot_size, uint64_t *sequence) {
+  const unsigned char *newest = NULL;
+  *sequence = 0;
+  for (int s = 0; s < 2; s++) {
+    const unsigned char *slot = map + slot_offset + s*slot_size;
+    Reader in = { slot, slot+SLOT_HEADER, false };
+    uint64_t hash = get_u64(&in);
+    uint64_t seq = get_u64(&in);
+    uint64_t len = get_u64(&in);
+    if (seq == 0 || len > slot_size - SLOT_HEADER || hash != hash_bytes(slot+8, 16+len)) { continue; }
+    if (seq > *sequence) {
+      *sequence = seq;
+      newest = slot;
+    }
+  }
+  return newest;
+}
+
+
+/* CKPT OPEN
+ * Maps a checkpoint file for saving, creating it if it doesn't exist, and carries on its sequence if it does
+ * Refuses to touch a file that isn't a checkpoint in this build's format rather than overwrite it
+ */
+
+int ckpt_open(Checkpoint *ckpt, const char *path) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  *ckpt = (Checkpoint){0};
+  ckpt->slot_offset = page;
+  ckpt->slot_size = round_up(SLOT_HEADER + STATE_MAX_BYTES, page);
+  ckpt->size = ckpt->slot_offset + 2*ckpt->slot_size;
+
+  ckpt->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  struct stat info;
+  if (ckpt->fd < 0 || fstat(ckpt->fd, &info) < 0) {
+    perror(path);
+    if (ckpt->fd >= 0) { close(ckpt->fd); }
+    return -1;
+  }
+  int fresh = info.st_size == 0;
+  if (!fresh && (size_t)info.st_size != ckpt->size) {
+    fprintf(stderr, "%s: not a checkpoint this build can write, delete it to start over\n", path);
+    close(ckpt->fd);
+    return -1;
+  }
+  if (fresh && ftruncate(ckpt->fd, ckpt->size) < 0) {
+    perror(path);
+    close(ckpt->fd);
+    return -1;
+  }
+
+  void *map = mmap(NULL, ckpt->size, PROT_READ | PROT_WRITE, MAP_SHARED, ckpt->fd, 0);
+  if (map == MAP_FAILED) {
+    perror(path);
+    close(ckpt->fd);
+    return -1;
+  }
+  ckpt->map = map;
+
+  if (fresh) {
+    memcpy(ckpt->map, CKPT_MAGIC, 4);
+    ckpt->map[4] = CKPT_VERSION;
+    ckpt->map[5] = REPLAY_VERSION;
+    put_u64(ckpt->map+8, ckpt->slot_offset);
+    put_u64(ckpt->map+16, ckpt->slot_size);
+    msync(ckpt->map, page, MS_SYNC);
+    return 0;
+  }
+
+  size_t slot_offset, slot_size;
+  if (read_header(ckpt->map, ckpt->size, &slot_offset, &slot_size) < 0
+      || slot_offset != ckpt->slot_offset || slot_size != ckpt->slot_size) {
+    fprintf(stderr, "%s: not a checkpoint this build can write, delete it to start over\n", path);
+    ckpt_close(ckpt);
+    return -1;
+  }
+  newest_slot(ckpt->map, slot_offset, slot_size, &ckpt->sequence);
+  return 0;
+}
+
+
+/* CKPT SAVE
+ * Packs the game straight into the older of the two slots and seals it with its sequence number and checksum
+ * The pages are handed to the kernel to write back in its own time, so this costs about what pack_state() does
+ * If the game dies part way through, the half written slot fails its checksum and the previous checkpoint stands
+ */
+
+int ckpt_save(Checkpoint *ckpt, const GameState *game) {
+  uint64_t sequence = ckpt->sequence + 1;
+  unsigned char *slot = ckpt->map + ckpt->slot_offset + (sequence % 2) * ckpt->slot_size;
+
+  size_t len = pack_state(game, slot+SLOT_HEADER);
+  put_u64(slot+8, sequence);
+  put_u64(slot+16, len);
+  put_u64(slot, hash_bytes(slot+8, 16+len));
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  if (msync(slot, round_up(SLOT_HEADER + len, page), MS_ASYNC) < 0) {
+    return -1;
+  }
+  ckpt->sequence = sequence;
+  return 0;
+}
+
+// Waits for everything saved to reach the disk, then unmaps the file
+void ckpt_close(Checkpoint *ckpt) {
+  msync(ckpt->map, ckpt->size, MS_SYNC);
+  munmap(ckpt->map, ckpt->size);
+  close(ckpt->fd);
+}
+
+
+// Maps a checkpoint file and restores the newest whole checkpoint in it, returns -1 if there isn't one
+int ckpt_load(const char *path, GameState *game) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  struct stat info;
+  if (fstat(fd, &info) < 0 || info.st_size < HEADER_SIZE) {
+    fprintf(stderr, "%s: not a checkpoint\n", path);
+    close(fd);
+    return -1;
+  }
+  size_t size = info.st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror(path);
+    return -1;
+  }
+  const unsigned char *map = data;
+
+  size_t slot_offset, slot_size;
+  uint64_t sequence;
+  const unsigned char *slot = NULL;
+  if (read_header(map, size, &slot_offset, &slot_size) < 0) {
+    fprintf(stderr, "%s: not a checkpoint, or from a build with a different format\n", path);
+  }
+  else if (!(slot = newest_slot(map, slot_offset, slot_size, &sequence))) {
+    fprintf(stderr, "%s: no whole checkpoint in it\n", path);
+  }
+  else if (unpack_state(game, slot+SLOT_HEADER, get_u64(&(Reader){ slot+16, slot+24, false })) < 0) {
+    fprintf(stderr, "%s: checkpoint passed its checksum but didn't unpack\n", path);
+    slot = NULL;
+  }
+
+  munmap(data, size);
+  return slot ? 0 : -1;
+}
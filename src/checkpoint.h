@@ -0,0 +1,27 @@
+#include "game.h"
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+// Default gap between automatic checkpoints
+#define CHECKPOINT_INTERVAL (5*TICK_RATE)
+
+/* A checkpoint file kept mapped into memory for as long as the game runs
+ * The file has a header page and then two slots, and each save goes into the older slot with the next sequence number
+ * Each slot starts with a checksum of itself, so a save cut off half way is detected and the other slot is used
+ * That way the file always holds a whole checkpoint, and saving never waits for the disk
+ */
+typedef struct Checkpoint {
+  int fd;
+  unsigned char *map;
+  size_t size;
+  size_t slot_offset, slot_size;
+  uint64_t sequence;
+} Checkpoint;
+
+int ckpt_open(Checkpoint *ckpt, const char *path);
+int ckpt_save(Checkpoint *ckpt, const GameState *game);
+void ckpt_close(Checkpoint *ckpt);
+int ckpt_load(const char *path, GameState *game);
+
+#endif
@@ -0,0 +1,162 @@
+#include "collide.h"
+
+
+// Shortest signed distance between two points on a wrapping axis
+double wrap_delta(double delta, double period) {
+  if (delta > period/2) { return delta - period; }
+  if (delta < -period/2) { return delta + period; }
+  return delta;
+}
+
+
+/* SWEEP CIRCLE
+ * Something at (sy, sx) from a point moves by (my, mx) over a step, both relative to that point
+ * Finds the earliest fraction of the step at which it comes within reach, as the first root of |s + m t|^2 = reach^2
+ * Returns false if it stays out of reach for the whole step, or starts in reach and leaves it
+ */
+
+int sweep_circle(double sy, double sx, double my, double mx, double reach, double *toi) {
+  double a = my*my + mx*mx;
+  double b = sy*my + sx*mx;
+  double c = sy*sy + sx*sx - reach*reach;
+
+  // Starting in reach only counts if it stays there or closes in, so a torpedo launched right at the edge gets away
+  if (c < 0) {
+    *toi = 0;
+    return b < 0 || a + 2*b + c < 0;
+  }
+
+  // Out of reach, so it can only come into reach while closing in
+  if (a == 0 || b >= 0) { return false; }
+
+  double disc = b*b - a*c;
+  if (disc < 0) { return false; }
+  double t = (-b - sqrt(disc)) / a;
+  if (t > 1) { return false; }
+
+  *toi = t;
+  return true;
+}
+
+
+// Which bucket a grid cell lands in, using the top bits of a multiplicative hash
+static int bucket_of(Broadphase *bp, int cell) {
+  return bp->bits ? ((unsigned)cell * 2654435761u) >> (32 - bp->bits) : 0;
+}
+
+
+/* BP SETUP
+ * Sizes the grid for an arena of height x width starting at (top, left), with cells no smaller than reach
+ */
+
+void bp_setup(Broadphase *bp, double top, double left, double height, double width, double reach) {
+  int rows = height / reach;
+  int cols = width / reach;
+  if (rows < 1) { rows = 1; }
+  if (cols < 1) { cols = 1; }
+
+  bp->top = top;
+  bp->left = left;
+  bp->height = height;
+  bp->width = width;
+  bp->rows = rows;
+  bp->cols = cols;
+  bp->cell_h = height / rows;
+  bp->cell_w = width / cols;
+}
+
+
+// Sorts entities 0..n-1 into hash buckets by grid cell, only allocating when the entity count grows
+void bp_build(Broadphase *bp, int n, const double *y, const double *x) {
+  if (n > bp->cap) {
+    bp->cap = n*2;
+    bp->cells = realloc(bp->cells, bp->cap * sizeof(int));
+    bp->items = realloc(bp->items, bp->cap * sizeof(int));
+  }
+  bp->n = n;
+
+  bp->bits = 3;
+  while ((1 << bp->bits) < 2*n) { bp->bits++; }
+  int n_buckets = 1 << bp->bits;
+  if (n_buckets > bp->buckets_cap) {
+    bp->buckets_cap = n_buckets;
+    bp->bucket_start = realloc(bp->bucket_start, (n_buckets + 1) * sizeof(int));
+  }
+  memset(bp->bucket_start, 0, (n_buckets + 1) * sizeof(int));
+
+  for (int i = 0; i < n; i++) {
+    int row = (y[i] - bp->top) / bp->cell_h;
+    int col = (x[i] - bp->left) / bp->cell_w;
+    if (row < 0) { row = 0; } else if (row >= bp->rows) { row = bp->rows-1; }
+    if (col < 0) { col = 0; } else if (col >= bp->cols) { col = bp->cols-1; }
+    bp->cells[i] = row * bp->cols + col;
+    bp->bucket_start[bucket_of(bp, bp->cells[i]) + 1]++;
+  }
+
+  for (int b = 0; b < n_buckets; b++) {
+    bp->bucket_start[b+1] += bp->bucket_start[b];
+  }
+
+  // Fill each bucket in entity order, using the start of the next bucket as a cursor then shifting it back
+  for (int i = 0; i < n; i++) {
+    bp->items[bp->bucket_start[bucket_of(bp, bp->cells[i])]++] = i;
+  }
+  for (int b = n_buckets; b > 0; b--) {
+    bp->bucket_start[b] = bp->bucket_start[b-1];
+  }
+  bp->bucket_start[0] = 0;
+}
+
+
+/* BP FIND PAIRS
+ * Lists every pair (i, j) with i < j whose cells are neighbours, wrapping around the arena edges
+ * Hash collisions can add pairs from unrelated cells, so candidates still need a proper distance check
+ * The order only depends on the input, so results are deterministic
+ */
+
+void bp_find_pairs(Broadphase *bp) {
+  bp->n_pairs = 0;
+
+  for (int i = 0; i < bp->n; i++) {
+    int row = bp->cells[i] / bp->cols;
+    int col = bp->cells[i] % bp->cols;
+
+    // Neighbouring cells can share a bucket (or be the same cell on tiny grids), only visit each bucket once
+    int near[9];
+    int n_near = 0;
+    for (int dr = -1; dr <= 1; dr++) {
+      for (int dc = -1; dc <= 1; dc++) {
+        int cell = ((row+dr+bp->rows) % bp->rows) * bp->cols + (col+dc+bp->cols) % bp->cols;
+        int bucket = bucket_of(bp, cell);
+        int seen = false;
+        for (int k = 0; k < n_near; k++) {
+          if (near[k] == bucket) { seen = true; }
+        }
+        if (!seen) { near[n_near++] = bucket; }
+      }
+    }
+
+    for (int k = 0; k < n_near; k++) {
+      for (int s = bp->bucket_start[near[k]]; s < bp->bucket_start[near[k]+1]; s++) {
+        int j = bp->items[s];
+        if (j <= i) { continue; }
+
+        if (bp->n_pairs == bp->pairs_cap) {
+          bp->pairs_cap = bp->pairs_cap ? bp->pairs_cap*2 : 64;
+          bp->pairs = realloc(bp->pairs, bp->pairs_cap * sizeof(*bp->pairs));
+        }
+        bp->pairs[bp->n_pairs][0] = i;
+        bp->pairs[bp->n_pairs][1] = j;
+        bp->n_pairs++;
+      }
+    }
+  }
+}
+
+void bp_free(Broadphase *bp) {
+  free(bp->cells);
+  free(bp->items);
+  free(bp->bucket_start);
+  free(bp->pairs);
+  *bp = (Broadphase){0};
+}
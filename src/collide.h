@@ -0,0 +1,29 @@
+#include "utils.h"
+
+#ifndef COLLIDE_H
+#define COLLIDE_H
+
+/* Spatial hash broadphase over a wrapping arena
+ * The arena is split into a grid of cells at least as big as the collision reach, so anything close enough to touch
+ * is in the same or a neighbouring cell. Cells are hashed into twice as many buckets as there are entities, so
+ * building (a counting sort by bucket) and finding pairs (the 3x3 block around each entity) are both linear
+ */
+typedef struct Broadphase {
+  double top, left, height, width;
+  double cell_h, cell_w;
+  int rows, cols;
+  int n, cap;
+  int bits, buckets_cap;
+  int *cells, *items, *bucket_start;
+  int (*pairs)[2];
+  int n_pairs, pairs_cap;
+} Broadphase;
+
+double wrap_delta(double delta, double period);
+int sweep_circle(double sy, double sx, double my, double mx, double reach, double *toi);
+void bp_setup(Broadphase *bp, double top, double left, double height, double width, double reach);
+void bp_build(Broadphase *bp, int n, const double *y, const double *x);
+void bp_find_pairs(Broadphase *bp);
+void bp_free(Broadphase *bp);
+
+#endif
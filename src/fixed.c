@@ -0,0 +1,319 @@
+#include "fixed.h"
+#include "game.h"
+
+
+/* Unit thrust vectors for the 8 headings as (y, x), the same directions thrust_vector() gives
+ * The diagonals are 1/sqrt(2) rounded to Q16.16, written out so no libm rounding can creep in
+ */
+#define DIAG 46341
+static const Fixed heading[8][2] = {
+  { -FIX_ONE, 0 },     // N
+  { -DIAG, DIAG },     // NE
+  { 0, FIX_ONE },      // E
+  { DIAG, DIAG },      // SE
+  { FIX_ONE, 0 },      // S
+  { DIAG, -DIAG },     // SW
+  { 0, -FIX_ONE },     // W
+  { -DIAG, -DIAG },    // NW
+};
+
+
+// Rounds to the nearest 1/65536, scaling by a power of two and lround() are both exact so this is the same everywhere
+Fixed to_fixed(double value) {
+  return (Fixed)lround(value * FIX_ONE);
+}
+
+// Every Q16.16 value fits in a double's 53 bit mantissa, so this is exact
+double from_fixed(Fixed value) {
+  return value / (double)FIX_ONE;
+}
+
+/* Products and quotients divide rather than shift, so they round towards zero
+ * That keeps mirrored motion mirrored, and the result is pinned down by the C standard rather than the compiler
+ */
+static Fixed fix_mul(int64_t a, int64_t b) {
+  return (Fixed)(a * b / FIX_ONE);
+}
+
+static int64_t clamp64(int64_t value, int64_t limit) {
+  return value > limit ? limit : value < -limit ? -limit : value;
+}
+
+
+// Integer square root (rounded down), one result bit per step so it never touches the FPU
+uint32_t isqrt64(uint64_t n) {
+  uint64_t root = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+  while (bit > n) { bit >>= 2; }
+
+  while (bit) {
+    if (n >= root + bit) {
+      n -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)root;
+}
+
+
+// How far outside reach (negative if inside) a sweep is after q/FIX_ONE of the step, in Q32.32 squared units
+static __int128 sweep_gap(int64_t y, int64_t x, int64_t vy, int64_t vx, int64_t reach, int64_t q) {
+  __int128 py = y*FIX_ONE + vy*q;
+  __int128 px = x*FIX_ONE + vx*q;
+  __int128 r = (__int128)reach * FIX_ONE;
+  return py*py + px*px - r*r;
+}
+
+/* FIXED SWEEP
+ * sweep_circle() for points on the Q16.16 grid, worked out in integers so every build finds the same hits
+ * The time of impact is found to the nearest 1/65536 of the step by bisecting between the start and the closest approach
+ */
+
+int fixed_sweep(double sy, double sx, double my, double mx, double reach, double *toi) {
+  int64_t y = to_fixed(sy);
+  int64_t x = to_fixed(sx);
+  int64_t vy = to_fixed(my);
+  int64_t vx = to_fixed(mx);
+  int64_t r = to_fixed(reach);
+
+  int64_t a = vy*vy + vx*vx;
+  int64_t b = y*vy + x*vx;
+  if (sweep_gap(y, x, vy, vx, r, 0) < 0) {
+    *toi = 0;
+    return b < 0 || sweep_gap(y, x, vy, vx, r, FIX_ONE) < 0;
+  }
+  if (a == 0 || b >= 0) { return false; }
+
+  __int128 closest = (__int128)(-b) * FIX_ONE / a;
+  int64_t hi = closest > FIX_ONE ? FIX_ONE : (int64_t)closest;
+  if (sweep_gap(y, x, vy, vx, r, hi) >= 0) { return false; }
+
+  // Outside at lo and inside at hi, and the gap only falls in between
+  int64_t lo = 0;
+  while (hi - lo > 1) {
+    int64_t mid = (lo + hi) / 2;
+    if (sweep_gap(y, x, vy, vx, r, mid) < 0) { hi = mid; }
+    else                                    { lo = mid; }
+  }
+  *toi = from_fixed((Fixed)hi);
+  return true;
+}
+
+
+static void quantize_object(ObjectData *data) {
+  double *fields[] = { &data->y, &data->x, &data->y1, &data->x1, &data->y2, &data->x2, &data->y3, &data->x3, &data->vely, &data->velx };
+  for (int i = 0; i < 10; i++) {
+    *fields[i] = from_fixed(to_fixed(*fields[i]));
+  }
+}
+
+/* USE FIXED POINT
+ * Switches a match over to fixed point physics and snaps everything in it onto the Q16.16 grid
+ * From then on every position and velocity in the GameState is a whole number of 1/65536ths, so it round trips exactly
+ */
+
+void use_fixed_point(GameState *game) {
+  game->fixed_point = true;
+
+  for (int i = 0; i < game->n_wells; i++) {
+    game->wells[i].y = from_fixed(to_fixed(game->wells[i].y));
+    game->wells[i].x = from_fixed(to_fixed(game->wells[i].x));
+    game->wells[i].mass = from_fixed(to_fixed(game->wells[i].mass));
+  }
+  for (int i = 0; i < game->n_players; i++) {
+    Player *player = &game->players[i];
+    quantize_object(&player->data);
+    player->spawn_y = from_fixed(to_fixed(player->spawn_y));
+    player->spawn_x = from_fixed(to_fixed(player->spawn_x));
+  }
+  for (int a = 0; a < game->n_alive; a++) {
+    quantize_object(&game->bullets[game->alive[a]].data);
+  }
+  game->ship_mass = from_fixed(to_fixed(game->ship_mass));
+}
+
+
+// Puts a new torpedo 2 units in front of its ship at the ship's velocity plus 0.5, using the heading table
+void fixed_launch(Bullet *bullet, const Player *player) {
+  const Fixed *h = heading[player->dir];
+  bullet->data = new_objectdata(from_fixed(to_fixed(player->data.y) + 2*h[Y]), from_fixed(to_fixed(player->data.x) + 2*h[X]));
+  bullet->data.vely = from_fixed(to_fixed(player->data.vely) + h[Y]/2);
+  bullet->data.velx = from_fixed(to_fixed(player->data.velx) + h[X]/2);
+}
+
+
+// Per thread scratch space, the same arrangement as the floating point path in game.c
+static _Thread_local struct {
+  FixedBodies ships, shots;
+  Fixed *field_y, *field_x;
+  int *shot_slot;
+  int field_cap, shot_cap;
+} scratch;
+
+static void fixed_reserve(FixedBodies *bodies, int n) {
+  if (n > bodies->cap) {
+    bodies->cap = n*2;
+    bodies->y    = realloc(bodies->y,    bodies->cap * sizeof(Fixed));
+    bodies->x    = realloc(bodies->x,    bodies->cap * sizeof(Fixed));
+    bodies->vely = realloc(bodies->vely, bodies->cap * sizeof(Fixed));
+    bodies->velx = realloc(bodies->velx, bodies->cap * sizeof(Fixed));
+  }
+  bodies->n = n;
+}
+
+static void fixed_free(FixedBodies *bodies) {
+  free(bodies->y);
+  free(bodies->x);
+  free(bodies->vely);
+  free(bodies->velx);
+  *bodies = (FixedBodies){0};
+}
+
+void free_fixed_scratch() {
+  fixed_free(&scratch.ships);
+  fixed_free(&scratch.shots);
+  free(scratch.field_y);
+  free(scratch.field_x);
+  free(scratch.shot_slot);
+  memset(&scratch, 0, sizeof scratch);
+}
+
+
+/* FIXED GRAVITY
+ * Pull towards a point mass at (wy, wx), strength is -2 for the original black hole, as in the floating point kernels
+ * The pull is strength / r^2 along the unit vector to the mass, and r comes from the integer square root
+ */
+
+static void fixed_gravity(FixedBodies *b, Fixed wy, Fixed wx, Fixed strength, Fixed d) {
+  for (int i = 0; i < b->n; i++) {
+    int64_t dy = (int64_t)b->y[i] - wy;
+    int64_t dx = (int64_t)b->x[i] - wx;
+    int64_t r2 = dy*dy + dx*dx;
+    if (r2 == 0) { continue; }
+
+    // r2 is Q32.32 so its root comes out in Q16.16, and the pull is capped well short of overflowing
+    int64_t r = isqrt64(r2);
+    int64_t g = clamp64(strength * ((int64_t)1 << 32) / r2, FIX_MAX_SPEED);
+    int64_t uy = dy * FIX_ONE / r;
+    int64_t ux = dx * FIX_ONE / r;
+    b->vely[i] = clamp64(b->vely[i] + fix_mul(fix_mul(g, uy), d), FIX_MAX_SPEED);
+    b->velx[i] = clamp64(b->velx[i] + fix_mul(fix_mul(g, ux), d), FIX_MAX_SPEED);
+  }
+}
+
+static void fixed_cap(FixedBodies *b, Fixed max) {
+  for (int i = 0; i < b->n; i++) {
+    int64_t vel = isqrt64((int64_t)b->vely[i]*b->vely[i] + (int64_t)b->velx[i]*b->velx[i]);
+    if (vel > max) {
+      b->vely[i] = (int64_t)b->vely[i] * max / vel;
+      b->velx[i] = (int64_t)b->velx[i] * max / vel;
+    }
+  }
+}
+
+static void fixed_integrate(FixedBodies *b, Fixed d) {
+  for (int i = 0; i < b->n; i++) {
+    b->y[i] += fix_mul(b->vely[i], d);
+    b->x[i] += fix_mul(b->velx[i], d);
+  }
+}
+
+static void fixed_wrap(FixedBodies *b, Fixed top, Fixed left, Fixed height, Fixed width) {
+  for (int i = 0; i < b->n; i++) {
+    if (b->y[i] >= top+height) { b->y[i] -= height; }
+    else if (b->y[i] <= top) { b->y[i] += height; }
+    if (b->x[i] >= left+width) { b->x[i] -= width; }
+    else if (b->x[i] <= left) { b->x[i] += width; }
+  }
+}
+
+
+/* FIXED MOTION
+ * The movement half of update_physics() in Q16.16: thrust, gravity, the velocity cap, then integrating and wrapping
+ * Gravity is always summed directly, the Barnes-Hut tree and theta are only used by the floating point path
+ * Only integer operations happen between gathering and scattering, so every build and every CPU gets the same game
+ */
+
+void fixed_motion(GameState *game, const int *thrusting, Fixed d) {
+  FixedBodies *ships = &scratch.ships;
+  FixedBodies *shots = &scratch.shots;
+  fixed_reserve(ships, game->n_players);
+  fixed_reserve(shots, game->n_alive);
+  if (game->n_alive > scratch.shot_cap) {
+    scratch.shot_cap = game->n_alive*2;
+    scratch.shot_slot = realloc(scratch.shot_slot, scratch.shot_cap * sizeof(int));
+  }
+  if (game->n_players > scratch.field_cap) {
+    scratch.field_cap = game->n_players*2;
+    scratch.field_y = realloc(scratch.field_y, scratch.field_cap * sizeof(Fixed));
+    scratch.field_x = realloc(scratch.field_x, scratch.field_cap * sizeof(Fixed));
+  }
+
+  // Engine thrust of 0.005 a tick goes straight onto the velocity as the ships are gathered
+  for (int i = 0; i < game->n_players; i++) {
+    Player *player = &game->players[i];
+    ships->y[i] = to_fixed(player->data.y);
+    ships->x[i] = to_fixed(player->data.x);
+    ships->vely[i] = to_fixed(player->data.vely);
+    ships->velx[i] = to_fixed(player->data.velx);
+    if (thrusting[i]) {
+      ships->vely[i] += (int64_t)heading[player->dir][Y] * d * 5 / (1000LL * FIX_ONE);
+      ships->velx[i] += (int64_t)heading[player->dir][X] * d * 5 / (1000LL * FIX_ONE);
+    }
+  }
+
+  int n_shots = 0;
+  for (int a = 0; a < game->n_alive; a++) {
+    Bullet *bullet = &game->bullets[game->alive[a]];
+    shots->y[n_shots] = to_fixed(bullet->data.y);
+    shots->x[n_shots] = to_fixed(bullet->data.x);
+    shots->vely[n_shots] = to_fixed(bullet->data.vely);
+    shots->velx[n_shots] = to_fixed(bullet->data.velx);
+    scratch.shot_slot[n_shots++] = game->alive[a];
+  }
+  shots->n = n_shots;
+
+  for (int w = 0; w < game->n_wells; w++) {
+    BlackHole *well = &game->wells[w];
+    Fixed strength = to_fixed(-2 * well->mass);
+    fixed_gravity(ships, to_fixed(well->y), to_fixed(well->x), strength, d);
+    if (game->torpedo_gravity) { fixed_gravity(shots, to_fixed(well->y), to_fixed(well->x), strength, d); }
+  }
+
+  // Ships are both sources and targets, so take their positions before any of them have been pulled
+  if (game->ship_mass > 0) {
+    memcpy(scratch.field_y, ships->y, ships->n * sizeof(Fixed));
+    memcpy(scratch.field_x, ships->x, ships->n * sizeof(Fixed));
+    Fixed strength = to_fixed(-2 * game->ship_mass);
+    for (int s = 0; s < ships->n; s++) {
+      fixed_gravity(ships, scratch.field_y[s], scratch.field_x[s], strength, d);
+      if (game->torpedo_gravity) { fixed_gravity(shots, scratch.field_y[s], scratch.field_x[s], strength, d); }
+    }
+  }
+
+  Fixed top = ARENA_TOP * FIX_ONE, left = ARENA_LEFT * FIX_ONE;
+  Fixed height = game->arena_h * FIX_ONE, width = game->arena_w * FIX_ONE;
+  fixed_cap(ships, FIX_ONE);
+  fixed_integrate(ships, d);
+  fixed_wrap(ships, top, left, height, width);
+  fixed_integrate(shots, d);
+  fixed_wrap(shots, top, left, height, width);
+
+  for (int i = 0; i < game->n_players; i++) {
+    game->players[i].data.y = from_fixed(ships->y[i]);
+    game->players[i].data.x = from_fixed(ships->x[i]);
+    game->players[i].data.vely = from_fixed(ships->vely[i]);
+    game->players[i].data.velx = from_fixed(ships->velx[i]);
+  }
+  for (int s = 0; s < n_shots; s++) {
+    Bullet *bullet = &game->bullets[scratch.shot_slot[s]];
+    bullet->data.y = from_fixed(shots->y[s]);
+    bullet->data.x = from_fixed(shots->x[s]);
+    bullet->data.vely = from_fixed(shots->vely[s]);
+    bullet->data.velx = from_fixed(shots->velx[s]);
+  }
+}
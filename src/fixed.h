@@ -0,0 +1,32 @@
+#include "utils.h"
+
+#ifndef FIXED_H
+#define FIXED_H
+
+// Q16.16 fixed point, 16 whole bits and 16 fraction bits, anything multiplied or divided goes through 64 bits
+typedef int32_t Fixed;
+#define FIX_ONE 65536
+
+// One tick as a fraction of the old frame length, the same 0.6 TICK_D is but rounded to the nearest 1/65536 in integers
+#define FIX_TICK ((Fixed)(((int64_t)TICK_NS * FIX_ONE * 10 + 333333333/2) / 333333333))
+
+// Nothing moves faster than this many units a tick, so a slingshot past a black hole can't overflow a position
+#define FIX_MAX_SPEED (64 * FIX_ONE)
+
+// Structure of arrays copy of the ships or torpedoes in fixed point, 16 bytes a body instead of the 48 Bodies uses
+typedef struct FixedBodies {
+  int n, cap;
+  Fixed *y, *x;
+  Fixed *vely, *velx;
+} FixedBodies;
+
+Fixed to_fixed(double value);
+double from_fixed(Fixed value);
+uint32_t isqrt64(uint64_t n);
+int fixed_sweep(double sy, double sx, double my, double mx, double reach, double *toi);
+void use_fixed_point(GameState *game);
+void fixed_launch(Bullet *bullet, const Player *player);
+void fixed_motion(GameState *game, const int *thrusting, Fixed d);
+void free_fixed_scratch();
+
+#endif
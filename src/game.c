@@ -0,0 +1,721 @@
+#include "game.h"
+#include "collide.h"
+#include "kernels.h"
+#include "gravity.h"
+#include "fixed.h"
+
+
+/* NEW GAME
+ * Populates a fresh GameState: the black hole, the players, and empty spots for torpedoes to spawn
+ * Players 1 and 2 start in their usual corners, any extra ships are spaced out on a ring around the black hole
+ */
+
+void new_game(GameState *game, int n_players) {
+  game->n_wells = 1;
+  game->wells[0] = (BlackHole){WIN_H+0.5, (double)WIN_W/2, 1};
+  game->n_players = n_players;
+  game->n_bullets = 0;
+  game->n_alive = 0;
+  game->free_bullet = -1;
+  game->torpedo_limit = SHIP_TORPEDOES;
+  game->ship_mass = 0;
+  game->theta = DEFAULT_THETA;
+  game->torpedo_gravity = false;
+  game->fixed_point = false;
+  game->arena_h = ARENA_H;
+  game->arena_w = ARENA_W;
+  game->tick = 0;
+  game->rng = 1;
+
+  game->players[0] = new_player(PLAYER1, P1_Y, P1_X, NW, 0);
+  game->players[1] = new_player(PLAYER2, P2_Y, P2_X, SE, 0);
+
+  for (int i = 2; i < n_players; i++) {
+    double angle = 2*M_PI * (i-2) / (n_players-2) + M_PI/8;
+    double y = game->wells[0].y - 45*cos(angle);
+    double x = game->wells[0].x + 45*sin(angle);
+    int dir = (int)lround(angle / (2*M_PI) * 8 + 2) % 8;
+    game->players[i] = new_player(i%2 ? PLAYER2 : PLAYER1, y, x, dir, 0);
+  }
+}
+
+
+// Adds more black holes, the central one stays and the rest are spread out on a ring around it
+void add_wells(GameState *game, int n_wells, double mass) {
+  for (int i = 0; i < n_wells && game->n_wells < MAX_WELLS; i++) {
+    double angle = 2*M_PI * i / n_wells;
+    double y = game->wells[0].y - 20*cos(angle);
+    double x = game->wells[0].x + 20*sin(angle);
+    game->wells[game->n_wells++] = (BlackHole){y, x, mass};
+  }
+}
+
+
+static void stretch(double *y, double *x, double sy, double sx) {
+  *y = ARENA_TOP + (*y - ARENA_TOP) * sy;
+  *x = ARENA_LEFT + (*x - ARENA_LEFT) * sx;
+}
+
+/* RESIZE ARENA
+ * Changes the arena to h by w physics units, stretching everything in it (spawn points too) to keep its place
+ * relative to the edges, so a bigger arena is set out like the usual one. Call it before the match starts
+ */
+
+void resize_arena(GameState *game, int h, int w) {
+  double sy = (double)h / game->arena_h;
+  double sx = (double)w / game->arena_w;
+  game->arena_h = h;
+  game->arena_w = w;
+
+  for (int i = 0; i < game->n_wells; i++) {
+    stretch(&game->wells[i].y, &game->wells[i].x, sy, sx);
+  }
+  for (int i = 0; i < game->n_players; i++) {
+    Player *player = &game->players[i];
+    stretch(&player->spawn_y, &player->spawn_x, sy, sx);
+    stretch(&player->data.y, &player->data.x, sy, sx);
+    stretch(&player->data.y1, &player->data.x1, sy, sx);
+    stretch(&player->data.y2, &player->data.x2, sy, sx);
+    stretch(&player->data.y3, &player->data.x3, sy, sx);
+  }
+  for (int a = 0; a < game->n_alive; a++) {
+    ObjectData *data = &game->bullets[game->alive[a]].data;
+    stretch(&data->y, &data->x, sy, sx);
+    stretch(&data->y1, &data->x1, sy, sx);
+    stretch(&data->y2, &data->x2, sy, sx);
+    stretch(&data->y3, &data->x3, sy, sx);
+  }
+}
+
+// Reads a --world ROWSxCOLS size in terminal cells into physics units, returns false if it is malformed or too big
+int parse_world(const char *text, int *h, int *w) {
+  int rows, cols;
+  if (sscanf(text, "%dx%d", &rows, &cols) != 2 || rows < 10 || cols < 10 || rows > MAX_WORLD || cols > MAX_WORLD) {
+    fprintf(stderr, "--world takes ROWSxCOLS, each between 10 and %d\n", MAX_WORLD);
+    return false;
+  }
+  *h = 2*rows;
+  *w = cols;
+  return true;
+}
+
+
+// Puts every ship back at its spawn point with no score and clears all torpedoes, for a rematch
+void reset_match(GameState *game) {
+  for (int i = 0; i < game->n_players; i++) {
+    destroy(&game->players[i]);
+    game->players[i].score = 0;
+    game->players[i].torpedoes = 0;
+    game->players[i].torpedo = NO_TORPEDO;
+  }
+  game->n_bullets = 0;
+  game->n_alive = 0;
+  game->free_bullet = -1;
+}
+
+
+// Automates resetting the players position when they are destroyed, torpedoes already fired fly on
+void destroy(Player *player) {
+  Player was = *player;
+  *player = new_player(was.type, was.spawn_y, was.spawn_x, was.spawn_dir, was.score-50);
+  player->torpedoes = was.torpedoes;
+  player->torpedo = was.torpedo;
+}
+
+
+/* TORPEDO POOL
+ * Torpedoes live in a fixed pool, so firing one or losing one is a few stores however many there are, and never allocates
+ * A new torpedo takes the most recently freed slot (or the first never used one) and goes on the end of alive
+ * A spent one swaps the last live torpedo into its place in alive, and its slot goes on the front of the free list
+ */
+
+static Bullet *torpedo_spawn(GameState *game, Bullet torpedo) {
+  int slot = game->free_bullet;
+  if (slot >= 0) {
+    game->free_bullet = game->bullets[slot].link;
+    torpedo.gen = game->bullets[slot].gen;
+  }
+  else if (game->n_bullets < MAX_BULLETS) {
+    slot = game->n_bullets++;
+    torpedo.gen = 1;
+  }
+  else {
+    return NULL;
+  }
+
+  torpedo.link = game->n_alive;
+  game->alive[game->n_alive++] = slot;
+  game->bullets[slot] = torpedo;
+
+  Player *owner = &game->players[torpedo.owner];
+  owner->torpedoes++;
+  owner->torpedo = torpedo.gen << 16 | slot;
+  return &game->bullets[slot];
+}
+
+static void torpedo_free(GameState *game, int slot) {
+  Bullet *bullet = &game->bullets[slot];
+  int last = game->alive[--game->n_alive];
+  game->alive[bullet->link] = last;
+  game->bullets[last].link = bullet->link;
+  game->players[bullet->owner].torpedoes--;
+
+  unsigned gen = (bullet->gen + 1) & 0xFFFF;
+  *bullet = err_bullet();
+  bullet->gen = gen ? gen : 1;
+  bullet->link = game->free_bullet;
+  game->free_bullet = slot;
+}
+
+// The torpedo a handle was taken for, or NULL if that torpedo is gone (even if its slot has been used again since)
+Bullet *torpedo_get(GameState *game, TorpedoRef ref) {
+  int slot = ref & 0xFFFF;
+  if (ref == NO_TORPEDO || slot >= game->n_bullets) { return NULL; }
+  Bullet *bullet = &game->bullets[slot];
+  return bullet->type == BULLET && bullet->gen == ref >> 16 ? bullet : NULL;
+}
+
+/* Rebuilds the free list, alive and every ship's torpedo count and newest torpedo from which slots hold one
+ * For a game put back together slot by slot (a spectator's), where the order physics went in doesn't matter
+ */
+void torpedo_reindex(GameState *game) {
+  game->n_alive = 0;
+  game->free_bullet = -1;
+  for (int i = 0; i < game->n_players; i++) {
+    game->players[i].torpedoes = 0;
+    game->players[i].torpedo = NO_TORPEDO;
+  }
+
+  for (int i = game->n_bullets-1; i >= 0; i--) {
+    Bullet *bullet = &game->bullets[i];
+    bullet->gen = 1;
+    if (bullet->type != BULLET || bullet->owner < 0 || bullet->owner >= game->n_players) {
+      bullet->type = ERR;
+      bullet->link = game->free_bullet;
+      game->free_bullet = i;
+    }
+  }
+  for (int i = 0; i < game->n_bullets; i++) {
+    Bullet *bullet = &game->bullets[i];
+    if (bullet->type != BULLET) { continue; }
+    bullet->link = game->n_alive;
+    game->alive[game->n_alive++] = i;
+
+    Player *owner = &game->players[bullet->owner];
+    Bullet *newest = torpedo_get(game, owner->torpedo);
+    owner->torpedoes++;
+    if (!newest || bullet->fuse > newest->fuse) { owner->torpedo = 1 << 16 | i; }
+  }
+}
+
+
+// Torpedo hits credit whoever fired them, in a duel a ship that shoots itself hands the points to its opponent
+static void torpedo_hit(GameState *game, int ship, int slot) {
+  int owner = game->bullets[slot].owner;
+  if (owner == ship && game->n_players == 2) { owner = 1-ship; }
+
+  destroy(&game->players[ship]);
+  torpedo_free(game, slot);
+  if (owner != ship) { game->players[owner].score += 250; }
+}
+
+
+// A touch found by the collision pass, between entities a < b, a fraction toi of the way through the step
+typedef struct Contact {
+  double toi;
+  int a, b;
+} Contact;
+
+// Per thread scratch space for the movement kernels and the collision pass, grown as needed and reused every tick
+static _Thread_local struct {
+  Bodies ships, shots;
+  int *shot_slot, *thrusting;
+  int shot_cap, ship_cap;
+  double *from_y, *from_x;
+  int from_cap;
+  Broadphase bp;
+  double *y, *x, *my, *mx;
+  int *ref, *hit;
+  int cap;
+  Contact *contacts;
+  int contacts_cap;
+} scratch;
+
+
+// Releases this thread's physics scratch space, for worker threads that are about to exit
+void free_physics_scratch() {
+  bodies_free(&scratch.ships);
+  bodies_free(&scratch.shots);
+  bp_free(&scratch.bp);
+  free(scratch.shot_slot);
+  free(scratch.thrusting);
+  free(scratch.from_y);
+  free(scratch.from_x);
+  free(scratch.y);
+  free(scratch.x);
+  free(scratch.my);
+  free(scratch.mx);
+  free(scratch.contacts);
+  free(scratch.ref);
+  free(scratch.hit);
+  memset(&scratch, 0, sizeof scratch);
+  free_gravity_scratch();
+  free_fixed_scratch();
+}
+
+
+// Earliest touches first, ties in entity order so the result never depends on how qsort() breaks them
+static int by_toi(const void *p, const void *q) {
+  const Contact *c = p, *d = q;
+  if (c->toi != d->toi) { return c->toi < d->toi ? -1 : 1; }
+  if (c->a != d->a) { return c->a - d->a; }
+  return c->b - d->b;
+}
+
+// Adds an entity to the collision pass, with where it ended the step and how far it moved to get there
+static void add_entity(const GameState *game, int *n, int ref, double y, double x, double from_y, double from_x) {
+  scratch.y[*n] = y;
+  scratch.x[*n] = x;
+  scratch.my[*n] = wrap_delta(y - from_y, game->arena_h);
+  scratch.mx[*n] = wrap_delta(x - from_x, game->arena_w);
+  scratch.ref[(*n)++] = ref;
+}
+
+/* COLLIDE
+ * Finds everything that touched during the step (came within 2 units, across the arena edges too), not just what is
+ * touching at the end of it, by sweeping each pair along the straight lines they moved on. So nothing can pass through
+ * a ship however long the step is
+ * Touches are resolved in the order they happened: ships crashing destroy each other, torpedoes destroy the ship they
+ * hit, and torpedoes from different ships cancel out
+ * Ships also die within 1 unit of a black hole, which torpedoes fly straight over
+ * Anything already destroyed this step is skipped for the rest of the pass
+ * Fixed point matches sweep in integers, so every build agrees on exactly which touches count and in what order
+ */
+
+static void collide(GameState *game) {
+  int n_ships = game->n_players;
+  int n_solid = n_ships + game->n_wells;
+  int n = n_solid + game->n_alive;
+
+  if (n > scratch.cap) {
+    scratch.cap = n*2;
+    scratch.y = realloc(scratch.y, scratch.cap * sizeof(double));
+    scratch.x = realloc(scratch.x, scratch.cap * sizeof(double));
+    scratch.my = realloc(scratch.my, scratch.cap * sizeof(double));
+    scratch.mx = realloc(scratch.mx, scratch.cap * sizeof(double));
+    scratch.ref = realloc(scratch.ref, scratch.cap * sizeof(int));
+    scratch.hit = realloc(scratch.hit, scratch.cap * sizeof(int));
+  }
+
+  // Ships first, then black holes, then live torpedoes, ref maps back to the player, well or bullet slot
+  n = 0;
+  for (int i = 0; i < n_ships; i++) {
+    ObjectData *data = &game->players[i].data;
+    add_entity(game, &n, i, data->y, data->x, scratch.from_y[i], scratch.from_x[i]);
+  }
+  for (int i = 0; i < game->n_wells; i++) {
+    add_entity(game, &n, i, game->wells[i].y, game->wells[i].x, game->wells[i].y, game->wells[i].x);
+  }
+  for (int a = 0; a < game->n_alive; a++) {
+    int slot = game->alive[a];
+    ObjectData *data = &game->bullets[slot].data;
+    add_entity(game, &n, slot, data->y, data->x, scratch.from_y[n_ships+a], scratch.from_x[n_ships+a]);
+  }
+  memset(scratch.hit, 0, n * sizeof(int));
+
+  // Two things can only have touched if they ended within reach plus both their moves of each other
+  double furthest = 0;
+  for (int i = 0; i < n; i++) {
+    double moved = fabs(scratch.my[i]) + fabs(scratch.mx[i]);
+    if (moved > furthest) { furthest = moved; }
+  }
+
+  Broadphase *bp = &scratch.bp;
+  bp_setup(bp, ARENA_TOP, ARENA_LEFT, game->arena_h, game->arena_w, 2 + 2*furthest);
+  bp_build(bp, n, scratch.y, scratch.x);
+  bp_find_pairs(bp);
+
+  int n_contacts = 0;
+  for (int p = 0; p < bp->n_pairs; p++) {
+    int a = bp->pairs[p][0];
+    int b = bp->pairs[p][1];
+
+    // Pairs are always (lower, higher), so ships come before black holes, which come before torpedoes
+    double reach = 2;
+    if (a < n_ships && b >= n_ships && b < n_solid) { reach = 1; }
+    else if (a >= n_ships && a < n_solid)           { continue; }
+    else if (a >= n_solid && game->bullets[scratch.ref[a]].owner == game->bullets[scratch.ref[b]].owner) { continue; }
+
+    // Relative to b, a moved by m and started at s, measured from where they ended up so the wrap is taken care of
+    double my = scratch.my[a] - scratch.my[b];
+    double mx = scratch.mx[a] - scratch.mx[b];
+    double sy = wrap_delta(scratch.y[a] - scratch.y[b], game->arena_h) - my;
+    double sx = wrap_delta(scratch.x[a] - scratch.x[b], game->arena_w) - mx;
+
+    double toi;
+    int touched = game->fixed_point ? fixed_sweep(sy, sx, my, mx, reach, &toi) : sweep_circle(sy, sx, my, mx, reach, &toi);
+    if (!touched) { continue; }
+
+    if (n_contacts == scratch.contacts_cap) {
+      scratch.contacts_cap = scratch.contacts_cap ? scratch.contacts_cap*2 : 16;
+      scratch.contacts = realloc(scratch.contacts, scratch.contacts_cap * sizeof(Contact));
+    }
+    scratch.contacts[n_contacts++] = (Contact){toi, a, b};
+  }
+  qsort(scratch.contacts, n_contacts, sizeof(Contact), by_toi);
+
+  for (int c = 0; c < n_contacts; c++) {
+    int a = scratch.contacts[c].a;
+    int b = scratch.contacts[c].b;
+    if (scratch.hit[a] || scratch.hit[b]) { continue; }
+
+    int ra = scratch.ref[a];
+    int rb = scratch.ref[b];
+
+    if (b < n_ships) {
+      destroy(&game->players[ra]);
+      destroy(&game->players[rb]);
+      scratch.hit[a] = scratch.hit[b] = true;
+    }
+    else if (b < n_solid) {
+      // Black holes are never used up, they stay put for the next ship
+      destroy(&game->players[ra]);
+      scratch.hit[a] = true;
+    }
+    else if (a < n_ships) {
+      torpedo_hit(game, ra, rb);
+      scratch.hit[a] = scratch.hit[b] = true;
+    }
+    else {
+      torpedo_free(game, ra);
+      torpedo_free(game, rb);
+      scratch.hit[a] = scratch.hit[b] = true;
+    }
+  }
+}
+
+
+/* FLOAT MOTION
+ * Movement is done on structure of arrays copies of the ships and torpedoes by the SIMD kernels, then copied back
+ */
+
+static void float_motion(GameState *game, const int *thrusting, double d) {
+  const Kernels *k = get_kernels();
+
+  Bodies *ships = &scratch.ships;
+  Bodies *shots = &scratch.shots;
+  bodies_reserve(ships, game->n_players);
+  bodies_reserve(shots, game->n_alive);
+  if (game->n_alive > scratch.shot_cap) {
+    scratch.shot_cap = game->n_alive*2;
+    scratch.shot_slot = realloc(scratch.shot_slot, scratch.shot_cap * sizeof(int));
+  }
+
+  for (int i=0; i < game->n_players; i++) {
+    Player *player = &game->players[i];
+    ships->ay[i] = thrusting[i] ? 0.005 * thrust_vector(player->dir, Y) * d : 0;
+    ships->ax[i] = thrusting[i] ? 0.005 * thrust_vector(player->dir, X) * d : 0;
+    ships->y[i] = player->data.y;
+    ships->x[i] = player->data.x;
+    ships->vely[i] = player->data.vely;
+    ships->velx[i] = player->data.velx;
+  }
+
+  // Gather the live torpedoes from the pool the same way
+  int n_shots = 0;
+  for (int a=0; a < game->n_alive; a++) {
+    Bullet *bullet = &game->bullets[game->alive[a]];
+    shots->y[n_shots] = bullet->data.y;
+    shots->x[n_shots] = bullet->data.x;
+    shots->vely[n_shots] = bullet->data.vely;
+    shots->velx[n_shots] = bullet->data.velx;
+    scratch.shot_slot[n_shots++] = game->alive[a];
+  }
+  shots->n = n_shots;
+
+  k->thrust(ships);
+  apply_gravity(game, ships, shots, d);
+
+  // Cap players velocity at 1, then update positions with the new velocities
+  k->cap(ships, 1);
+  k->integrate(ships, d);
+  k->wrap(ships, ARENA_TOP, ARENA_LEFT, game->arena_h, game->arena_w);
+  k->integrate(shots, d);
+  k->wrap(shots, ARENA_TOP, ARENA_LEFT, game->arena_h, game->arena_w);
+
+  for (int i=0; i < game->n_players; i++) {
+    game->players[i].data.y = ships->y[i];
+    game->players[i].data.x = ships->x[i];
+    game->players[i].data.vely = ships->vely[i];
+    game->players[i].data.velx = ships->velx[i];
+  }
+  for (int s=0; s < n_shots; s++) {
+    Bullet *bullet = &game->bullets[scratch.shot_slot[s]];
+    bullet->data.y = shots->y[s];
+    bullet->data.x = shots->x[s];
+    bullet->data.vely = shots->vely[s];
+    bullet->data.velx = shots->velx[s];
+  }
+}
+
+
+/* UPDATE PHYSICS
+ * Steps all physics forward by a whole number of fixed ticks
+ * Every quantity is scaled by the tick count rather than measured time, so identical inputs give identical games
+ * Movement goes through either the floating point kernels or the Q16.16 ones, depending on the match
+ */
+
+void update_physics(GameState *game, int ticks) {
+  Fixed step = (Fixed)((int64_t)ticks * FIX_TICK * to_fixed(PHYSICS_SPEED) / FIX_ONE);
+  double d = game->fixed_point ? from_fixed(step) : ticks * TICK_D * PHYSICS_SPEED;
+
+  // Trails shift every 4th tick, count whether one of those falls inside this step
+  int shift = (game->tick + ticks + 3)/4 != (game->tick + 3)/4;
+  game->tick += ticks;
+
+  if (game->n_players > scratch.ship_cap) {
+    scratch.ship_cap = game->n_players*2;
+    scratch.thrusting = realloc(scratch.thrusting, scratch.ship_cap * sizeof(int));
+  }
+
+  // Where every ship and torpedo starts the step, so the collision pass can sweep along what they did during it
+  int n_movers = game->n_players + game->n_alive;
+  if (n_movers > scratch.from_cap) {
+    scratch.from_cap = n_movers*2;
+    scratch.from_y = realloc(scratch.from_y, scratch.from_cap * sizeof(double));
+    scratch.from_x = realloc(scratch.from_x, scratch.from_cap * sizeof(double));
+  }
+  for (int i=0; i < game->n_players; i++) {
+    scratch.from_y[i] = game->players[i].data.y;
+    scratch.from_x[i] = game->players[i].data.x;
+  }
+  for (int a=0; a < game->n_alive; a++) {
+    scratch.from_y[game->n_players+a] = game->bullets[game->alive[a]].data.y;
+    scratch.from_x[game->n_players+a] = game->bullets[game->alive[a]].data.x;
+  }
+
+  for (int i=0; i < game->n_players; i++) {
+    Player *player = &game->players[i];
+
+    // Calculate the new positions of the colour trails
+    if (shift) {
+      shift_trails(&player->data);
+    }
+
+    // Check for overheating and calculate temperature & whether the engine is firing
+    scratch.thrusting[i] = false;
+    if (player->temp > 100) {
+      player->acc = false;
+      player->temp = -100;
+    }
+    else if (player->temp < 0) {
+      player->temp += d;
+    }
+    else if (!player->acc) {
+      player->temp -= d/2;
+      if (player->temp < 0) { player->temp = 0; }
+    }
+    else {
+      scratch.thrusting[i] = true;
+      player->temp += d/2;
+    }
+  }
+
+  for (int a=0; a < game->n_alive && shift; a++) {
+    shift_trails(&game->bullets[game->alive[a]].data);
+  }
+
+  if (game->fixed_point) { fixed_motion(game, scratch.thrusting, step); }
+  else                   { float_motion(game, scratch.thrusting, d); }
+
+  collide(game);
+
+  // Destroy bullets after certain amount of time, backwards so the torpedo swapped into a freed place was already done
+  for (int a=game->n_alive-1; a >= 0; a--) {
+    int slot = game->alive[a];
+    game->bullets[slot].fuse -= ticks;
+    if (game->bullets[slot].fuse < 0) {
+      torpedo_free(game, slot);
+    }
+  }
+}
+
+
+// Returns the newest torpedo a player fired, or NULL if it is gone (any older ones may still be flying)
+Bullet *player_torpedo(GameState *game, int player) {
+  return torpedo_get(game, game->players[player].torpedo);
+}
+
+
+// Launches a torpedo from the front of a ship, if it has one ready and there is room in the pool
+static void fire(GameState *game, int p) {
+  Player *player = &game->players[p];
+  if (player->torpedoes >= game->torpedo_limit) {
+    return;
+  }
+
+  Bullet *bullet = torpedo_spawn(game, new_bullet(player->data.y+2*thrust_vector(player->dir, Y), player->data.x+2*thrust_vector(player->dir, X), p));
+  if (!bullet) {
+    return;
+  }
+  bullet->data.vely = player->data.vely + 0.5*thrust_vector(player->dir, Y);
+  bullet->data.velx = player->data.velx + 0.5*thrust_vector(player->dir, X);
+  if (game->fixed_point) {
+    fixed_launch(bullet, player);
+  }
+}
+
+
+// Applies one control input to a player's ship
+void player_action(GameState *game, int p, enum Action action) {
+  Player *player = &game->players[p];
+
+  switch (action) {
+    case ENGINE:
+      if (player->temp >= 0) { player->acc = !player->acc; }
+      break;
+    case LEFT:
+      player->dir -= 1;
+      if (player->dir < 0) { player->dir += 8; }
+      break;
+    case RIGHT:
+      player->dir += 1;
+      player->dir %= 8;
+      break;
+    case FIRE:
+      fire(game, p);
+      break;
+  }
+}
+
+
+// Which player and action a control key is bound to, returns the player or -1 for keys that aren't controls
+int key_action(int key, enum Action *action) {
+  switch (key) {
+    case 'w':       *action = ENGINE; return 0;
+    case 'a':       *action = LEFT;   return 0;
+    case 'd':       *action = RIGHT;  return 0;
+    case 's':       *action = FIRE;   return 0;
+    case KEY_UP:    *action = ENGINE; return 1;
+    case KEY_LEFT:  *action = LEFT;   return 1;
+    case KEY_RIGHT: *action = RIGHT;  return 1;
+    case KEY_DOWN:  *action = FIRE;   return 1;
+  }
+  return -1;
+}
+
+
+// Handles the key presses for while the game is running
+void handle_game_inputs(GameState *game, int keys[], int *pause_toggle) {
+  for (int i = 0; i < 8 && keys[i] != ERR; i++) {
+    enum Action action;
+    int p = key_action(keys[i], &action);
+    if (keys[i] == '\n') { *pause_toggle = true; }
+    else if (p >= 0)     { player_action(game, p, action); }
+  }
+}
+
+
+// Appends an action to a tick's input, anything past MAX_INPUT_ACTIONS is dropped like extra keys are
+Input input_add(Input input, enum Action action) {
+  int n = input & 7;
+  if (n == MAX_INPUT_ACTIONS) {
+    return input;
+  }
+  return (input | (Input)action << (3 + 2*n)) + 1;
+}
+
+// Applies a tick's input to one player, in the order the actions were made
+void apply_input(GameState *game, int p, Input input) {
+  int n = input & 7;
+  for (int i = 0; i < n; i++) {
+    player_action(game, p, (input >> (3 + 2*i)) & 3);
+  }
+}
+
+
+// Copies a match, only the live part of each table, so saving a state every tick costs next to nothing
+void copy_state(GameState *dst, const GameState *src) {
+  dst->n_wells = src->n_wells;
+  dst->n_players = src->n_players;
+  dst->n_bullets = src->n_bullets;
+  dst->n_alive = src->n_alive;
+  dst->free_bullet = src->free_bullet;
+  dst->torpedo_limit = src->torpedo_limit;
+  dst->ship_mass = src->ship_mass;
+  dst->theta = src->theta;
+  dst->torpedo_gravity = src->torpedo_gravity;
+  dst->fixed_point = src->fixed_point;
+  dst->arena_h = src->arena_h;
+  dst->arena_w = src->arena_w;
+  dst->tick = src->tick;
+  dst->rng = src->rng;
+  memcpy(dst->wells, src->wells, src->n_wells * sizeof(BlackHole));
+  memcpy(dst->players, src->players, src->n_players * sizeof(Player));
+  memcpy(dst->bullets, src->bullets, src->n_bullets * sizeof(Bullet));
+  memcpy(dst->alive, src->alive, src->n_alive * sizeof(int));
+}
+
+
+// Moves one point part of the way from where it was to where it is, across the arena edges, unless it jumped there
+static void blend_point(const GameState *game, double *y, double *x, double prev_y, double prev_x, double alpha) {
+  double dy = wrap_delta(*y - prev_y, game->arena_h);
+  double dx = wrap_delta(*x - prev_x, game->arena_w);
+  if (total_dist_squared(dy, dx) > BLEND_SNAP*BLEND_SNAP) { return; }
+
+  *y = prev_y + alpha*dy;
+  *x = prev_x + alpha*dx;
+  if (*y >= ARENA_TOP+game->arena_h) { *y -= game->arena_h; }
+  else if (*y <= ARENA_TOP) { *y += game->arena_h; }
+  if (*x >= ARENA_LEFT+game->arena_w) { *x -= game->arena_w; }
+  else if (*x <= ARENA_LEFT) { *x += game->arena_w; }
+}
+
+/* BLEND STATES
+ * Builds the state to draw alpha of the way through the tick from prev to cur, for rendering faster than physics runs
+ * Only where ships and torpedoes are is blended, trails and everything else are cur's
+ * Respawns, new torpedoes and rollback corrections aren't smoothed over, they just appear where they now are
+ */
+
+void blend_states(GameState *shown, const GameState *prev, const GameState *cur, double alpha) {
+  copy_state(shown, cur);
+
+  for (int i = 0; i < cur->n_players && i < prev->n_players; i++) {
+    ObjectData *data = &shown->players[i].data;
+    blend_point(cur, &data->y, &data->x, prev->players[i].data.y, prev->players[i].data.x, alpha);
+  }
+
+  // A slot still holds the same torpedo if it was live last tick on the same generation, with less left on its fuse
+  for (int a = 0; a < cur->n_alive; a++) {
+    int slot = cur->alive[a];
+    if (slot >= prev->n_bullets) { continue; }
+    const Bullet *was = &prev->bullets[slot];
+    Bullet *now = &shown->bullets[slot];
+    if (was->type != BULLET || was->gen != now->gen || was->fuse <= now->fuse) { continue; }
+    blend_point(cur, &now->data.y, &now->data.x, was->data.y, was->data.x, alpha);
+  }
+}
+
+
+/* CHECK WINNER
+ * Returns the winning player number, or 0 if nobody has won yet
+ * A ship reaching 1000 points wins, and if any ship sinks to -1000 the match ends with the highest scorer winning
+ */
+
+int check_winner(const GameState *game) {
+  for (int i = 0; i < game->n_players; i++) {
+    if (game->players[i].score >= 1000) { return i+1; }
+  }
+
+  for (int i = 0; i < game->n_players; i++) {
+    if (game->players[i].score <= -1000) {
+      int best = i == 0 ? 1 : 0;
+      for (int j = 0; j < game->n_players; j++) {
+        if (game->players[j].score > game->players[best].score) { best = j; }
+      }
+      return best+1;
+    }
+  }
+
+  return 0;
+}
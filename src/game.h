@@ -0,0 +1,57 @@
+#include "utils.h"
+
+#ifndef GAME_H
+#define GAME_H
+
+#define PHYSICS_SPEED 1.0
+
+// Default drawing rate, independent of TICK_RATE since frames are blended between the last two physics states
+#define FRAMERATE 50
+
+// Anything that moved further than this in one tick teleported (respawned, or was corrected), so it isn't blended
+#define BLEND_SNAP 4
+
+#define P1_Y 76.5
+#define P1_X 25.5
+#define P2_Y 26.5
+#define P2_X 75.5
+
+#define WIN_H 51
+#define WIN_W 101
+#define UI_SIZE 30
+
+// The default playable area in physics units, y is doubled because terminal cells are twice as tall as they are wide
+// It exactly fills the game window, bigger arenas are seen through a camera
+#define ARENA_TOP 2
+#define ARENA_LEFT 1
+#define ARENA_H (2*WIN_H-4)
+#define ARENA_W (WIN_W-2)
+
+// How many torpedoes each ship can have in flight at once, unless the match says otherwise
+#define SHIP_TORPEDOES 1
+
+// One player's actions for one tick, in order, packed as a 3 bit count and then 2 bits per action
+typedef uint32_t Input;
+#define MAX_INPUT_ACTIONS 7
+
+void new_game(GameState *game, int n_players);
+void add_wells(GameState *game, int n_wells, double mass);
+void resize_arena(GameState *game, int h, int w);
+int parse_world(const char *text, int *h, int *w);
+void reset_match(GameState *game);
+void destroy(Player *player);
+void update_physics(GameState *game, int ticks);
+void free_physics_scratch();
+Bullet *torpedo_get(GameState *game, TorpedoRef ref);
+Bullet *player_torpedo(GameState *game, int player);
+void torpedo_reindex(GameState *game);
+void player_action(GameState *game, int p, enum Action action);
+int key_action(int key, enum Action *action);
+void handle_game_inputs(GameState *game, int keys[], int *pause_toggle);
+Input input_add(Input input, enum Action action);
+void apply_input(GameState *game, int p, Input input);
+void copy_state(GameState *dst, const GameState *src);
+void blend_states(GameState *shown, const GameState *prev, const GameState *cur, double alpha);
+int check_winner(const GameState *game);
+
+#endif
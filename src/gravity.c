@@ -0,0 +1,194 @@
+#include "gravity.h"
+
+// Past this depth sources are lumped together instead of splitting further, for when several share a position
+#define MAX_DEPTH 32
+
+
+// Per thread gravity sources and quadtree, grown as needed and reused every tick
+static _Thread_local struct {
+  double *y, *x, *mass;
+  int cap;
+  QuadNode *nodes;
+  int n_nodes, nodes_cap;
+} field;
+
+
+// Adds the pull of a single mass to one body, nothing pulls on something at exactly its own position
+static void pull(Bodies *b, int i, double sy, double sx, double mass, double d) {
+  double dy = b->y[i] - sy;
+  double dx = b->x[i] - sx;
+  double r2 = dy*dy + dx*dx;
+  if (r2 == 0) { return; }
+
+  double r = sqrt(r2);
+  double g = -2 * mass / r2;
+  b->vely[i] += g * (dy / r) * d;
+  b->velx[i] += g * (dx / r) * d;
+}
+
+static int new_node(double y, double x, double size) {
+  if (field.n_nodes == field.nodes_cap) {
+    field.nodes_cap = field.nodes_cap ? field.nodes_cap*2 : 256;
+    field.nodes = realloc(field.nodes, field.nodes_cap * sizeof(QuadNode));
+  }
+  field.nodes[field.n_nodes] = (QuadNode){y, x, size, 0, 0, 0, {-1, -1, -1, -1}, -1};
+  return field.n_nodes++;
+}
+
+// Which quarter of a node a point falls in, and creates that child if it doesn't exist yet
+static int child_for(int node, double y, double x) {
+  QuadNode *n = &field.nodes[node];
+  double half = n->size / 2;
+  int quarter = (y >= n->y + half) * 2 + (x >= n->x + half);
+
+  if (n->child[quarter] < 0) {
+    int child = new_node(n->y + (quarter/2) * half, n->x + (quarter%2) * half, half);
+    field.nodes[node].child[quarter] = child;
+  }
+  return field.nodes[node].child[quarter];
+}
+
+
+/* INSERT
+ * Walks a source down the tree, folding its mass into every node on the way
+ * An occupied leaf is split so the two sources end up in separate leaves
+ */
+
+static void insert(int node, int s, int depth) {
+  while (true) {
+    QuadNode *n = &field.nodes[node];
+    int empty = n->mass == 0 && n->body < 0 && n->child[0] < 0 && n->child[1] < 0 && n->child[2] < 0 && n->child[3] < 0;
+    int leaf = n->body >= 0;
+
+    double total = n->mass + field.mass[s];
+    n->my = (n->my * n->mass + field.y[s] * field.mass[s]) / total;
+    n->mx = (n->mx * n->mass + field.x[s] * field.mass[s]) / total;
+    n->mass = total;
+
+    if (empty) {
+      n->body = s;
+      return;
+    }
+    if (depth >= MAX_DEPTH) {
+      n->body = -1;
+      return;
+    }
+
+    // Push the resident source down a level before carrying on with the new one
+    if (leaf) {
+      int resident = n->body;
+      n->body = -1;
+      int child = child_for(node, field.y[resident], field.x[resident]);
+      field.nodes[child] = (QuadNode){field.nodes[child].y, field.nodes[child].x, field.nodes[child].size,
+        field.y[resident], field.x[resident], field.mass[resident], {-1, -1, -1, -1}, resident};
+    }
+
+    node = child_for(node, field.y[s], field.x[s]);
+    depth++;
+  }
+}
+
+// Adds up the pull on body i from everything under a node, opening cells that are too close to treat as one mass
+static void pull_from(Bodies *b, int i, int node, double theta, double d) {
+  QuadNode *n = &field.nodes[node];
+  if (n->mass == 0) { return; }
+
+  if (n->body >= 0) {
+    pull(b, i, field.y[n->body], field.x[n->body], field.mass[n->body], d);
+    return;
+  }
+
+  double dy = b->y[i] - n->my;
+  double dx = b->x[i] - n->mx;
+  int leaf = n->child[0] < 0 && n->child[1] < 0 && n->child[2] < 0 && n->child[3] < 0;
+  if (leaf || n->size * n->size < theta * theta * (dy*dy + dx*dx)) {
+    pull(b, i, n->my, n->mx, n->mass, d);
+    return;
+  }
+
+  for (int q = 0; q < 4; q++) {
+    if (n->child[q] >= 0) { pull_from(b, i, n->child[q], theta, d); }
+  }
+}
+
+
+/* APPLY GRAVITY
+ * Adds the pull of every black hole (and every ship, if ships have mass) to the ships, and to torpedoes if enabled
+ * A few fixed black holes go straight through the vectorised kernels, anything bigger builds a Barnes-Hut quadtree
+ * so each body only visits about log N cells
+ */
+
+void apply_gravity(GameState *game, Bodies *ships, Bodies *shots, double d) {
+  const Kernels *k = get_kernels();
+  int ship_sources = game->ship_mass > 0 ? ships->n : 0;
+  int n = game->n_wells + ship_sources;
+
+  if (n > field.cap) {
+    field.cap = n*2;
+    field.y = realloc(field.y, field.cap * sizeof(double));
+    field.x = realloc(field.x, field.cap * sizeof(double));
+    field.mass = realloc(field.mass, field.cap * sizeof(double));
+  }
+
+  if (n <= DIRECT_SUM_LIMIT) {
+    for (int w = 0; w < game->n_wells; w++) {
+      BlackHole *well = &game->wells[w];
+      k->gravity(ships, well->y, well->x, -2 * well->mass, d);
+      if (game->torpedo_gravity) { k->gravity(shots, well->y, well->x, -2 * well->mass, d); }
+    }
+
+    // Ships are both sources and targets, so take their positions before any of them have been pulled
+    for (int s = 0; s < ship_sources; s++) {
+      field.y[s] = ships->y[s];
+      field.x[s] = ships->x[s];
+    }
+    for (int s = 0; s < ship_sources; s++) {
+      for (int i = 0; i < ships->n; i++) { pull(ships, i, field.y[s], field.x[s], game->ship_mass, d); }
+      if (game->torpedo_gravity) {
+        for (int i = 0; i < shots->n; i++) { pull(shots, i, field.y[s], field.x[s], game->ship_mass, d); }
+      }
+    }
+    return;
+  }
+
+  // Gather every source and find a square that holds them all
+  double top = INFINITY, left = INFINITY, bottom = -INFINITY, right = -INFINITY;
+  for (int s = 0; s < n; s++) {
+    if (s < game->n_wells) {
+      field.y[s] = game->wells[s].y;
+      field.x[s] = game->wells[s].x;
+      field.mass[s] = game->wells[s].mass;
+    }
+    else {
+      field.y[s] = ships->y[s - game->n_wells];
+      field.x[s] = ships->x[s - game->n_wells];
+      field.mass[s] = game->ship_mass;
+    }
+    top = fmin(top, field.y[s]);
+    left = fmin(left, field.x[s]);
+    bottom = fmax(bottom, field.y[s]);
+    right = fmax(right, field.x[s]);
+  }
+
+  field.n_nodes = 0;
+  int root = new_node(top, left, fmax(bottom - top, right - left) + 1);
+  for (int s = 0; s < n; s++) {
+    insert(root, s, 0);
+  }
+
+  for (int i = 0; i < ships->n; i++) {
+    pull_from(ships, i, root, game->theta, d);
+  }
+  if (game->torpedo_gravity) {
+    for (int i = 0; i < shots->n; i++) { pull_from(shots, i, root, game->theta, d); }
+  }
+}
+
+// Releases this thread's gravity scratch space, for worker threads that are about to exit
+void free_gravity_scratch() {
+  free(field.y);
+  free(field.x);
+  free(field.mass);
+  free(field.nodes);
+  memset(&field, 0, sizeof field);
+}
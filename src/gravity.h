@@ -0,0 +1,26 @@
+#include "utils.h"
+#include "kernels.h"
+
+#ifndef GRAVITY_H
+#define GRAVITY_H
+
+// Below this many gravity sources it is cheaper to just add up every pull than to build a tree
+#define DIRECT_SUM_LIMIT 16
+
+// Barnes-Hut opening angle, a cell is treated as one mass when its size over its distance is below this
+#define DEFAULT_THETA 0.5
+
+/* One square of the Barnes-Hut quadtree
+ * Holds the total mass and centre of mass of every source inside it, leaves also remember which source they hold
+ */
+typedef struct QuadNode {
+  double y, x, size;
+  double my, mx, mass;
+  int child[4];
+  int body;
+} QuadNode;
+
+void apply_gravity(GameState *game, Bodies *ships, Bodies *shots, double d);
+void free_gravity_scratch();
+
+#endif
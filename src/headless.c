@@ -0,0 +1,353 @@
+#include "headless.h"
+#include "kernels.h"
+#include "gravity.h"
+#include "fixed.h"
+#include "replay.h"
+#include "net.h"
+#include "serial.h"
+#include "sched.h"
+#include "bot.h"
+#include "checkpoint.h"
+#include <poll.h>
+
+
+// Converts a key name from a script into the keycode handle_game_inputs() expects
+// Single characters map to themselves, arrows and enter are spelled out
+int parse_key(const char *name) {
+  if (strlen(name) == 1)            { return name[0]; }
+  if (strcmp(name, "UP") == 0)      { return KEY_UP; }
+  if (strcmp(name, "DOWN") == 0)    { return KEY_DOWN; }
+  if (strcmp(name, "LEFT") == 0)    { return KEY_LEFT; }
+  if (strcmp(name, "RIGHT") == 0)   { return KEY_RIGHT; }
+  if (strcmp(name, "ENTER") == 0)   { return '\n'; }
+  return ERR;
+}
+
+
+/* LOAD SCRIPT
+ * Reads "<milliseconds> <key>" lines into a Script, blank lines and lines starting with # are skipped
+ * Events must be in chronological order, returns -1 and reports the line number otherwise
+ */
+
+int load_script(FILE *file, Script *script) {
+  char line[128];
+  int line_num = 0;
+  *script = (Script){NULL, 0, 0};
+
+  while (fgets(line, sizeof line, file)) {
+    line_num++;
+    line[strcspn(line, "\n")] = '\0';
+
+    long time;
+    char name[16];
+    if (line[0] == '#' || sscanf(line, "%ld %15s", &time, name) != 2) {
+      continue;
+    }
+
+    int key = parse_key(name);
+    if (key == ERR || time < 0 || (script->count && time < script->events[script->count-1].time)) {
+      fprintf(stderr, "script line %d: bad event \"%s\"\n", line_num, line);
+      free_script(script);
+      return -1;
+    }
+
+    if (script->count == script->cap) {
+      script->cap = script->cap ? script->cap*2 : 64;
+      script->events = realloc(script->events, script->cap * sizeof(KeyEvent));
+    }
+    script->events[script->count++] = (KeyEvent){time, key};
+  }
+
+  return 0;
+}
+
+void free_script(Script *script) {
+  free(script->events);
+  *script = (Script){NULL, 0, 0};
+}
+
+
+/* NET HEADLESS
+ * One side of a network match fed from a script, for testing rollback on loopback without a terminal
+ * Each side runs as fast as the other lets it, to max_ticks, then waits until nothing is predicted any more
+ * and prints a hash of the final state, which must come out the same on both sides
+ */
+
+static int net_headless(const NetConfig *config, Script *script, GameState *game, long max_ticks) {
+  Net net;
+  if (net_open(&net, config) < 0) {
+    return 1;
+  }
+
+  int next = 0;
+  long fed = -1;
+  long long linger = 0;
+
+  while (!net.lost) {
+    net_poll(&net, game);
+
+    if (game->tick < max_ticks) {
+      // This tick's keys go in once, even if the game has to wait for the peer before it can use them
+      if (fed < game->tick) {
+        long now = game->tick * 1000 / TICK_RATE;
+        int keys_pressed[8];
+        int ch_num = 0;
+        while (next < script->count && script->events[next].time <= now && ch_num < 7) {
+          keys_pressed[ch_num++] = script->events[next++].key;
+        }
+        keys_pressed[ch_num] = ERR;
+        net_keys(&net, keys_pressed);
+        fed = game->tick;
+      }
+      if (net_advance(&net, game)) {
+        continue;
+      }
+    }
+    else {
+      net_rollback(&net, game);
+      // Keep answering for a moment once finished, in case the peer still needs this side's last inputs
+      if (net_confirmed_state(&net, game) == game) {
+        if (!linger) { linger = now_ns() + 200000000LL; }
+        else if (now_ns() > linger) { break; }
+      }
+    }
+
+    poll(&(struct pollfd){net.sock, POLLIN, 0}, 1, 1);
+  }
+
+  if (net.lost) {
+    fprintf(stderr, "Lost contact with the other player\n");
+    net_close(&net);
+    return 1;
+  }
+
+  static unsigned char packed[STATE_MAX_BYTES];
+  printf("P1 SCORE  %05d       P2 SCORE  %05d\n", game->players[0].score, game->players[1].score);
+  printf("ticks %d, state hash %016llx\n", game->tick, (unsigned long long)hash_bytes(packed, pack_state(game, packed)));
+  net_report(&net, stdout);
+  net_close(&net);
+  return 0;
+}
+
+
+/* HEADLESS MAIN
+ * Steps a match with no ncurses and no wall-clock pacing, feeding it key events from a script
+ * Usage: spacewar --headless [script|-] [--ticks N] [--ships N] [--simd scalar|sse2|avx2]
+ *                            [--wells N] [--ship-mass M] [--theta T] [--torpedo-gravity] [--torpedoes N] [--fixed] [--world ROWSxCOLS] [--step N] [--record FILE]
+ *                            [--checkpoint FILE [--checkpoint-every N]]
+ *                            [--net 1|2 --port P --peer HOST:PORT [--input-delay N] [--rollback N] [--latency MS]]
+ *                            [--bot [--bot-threads N] [--bot-ms MS]]
+ * Runs until somebody wins or N ticks have passed, then prints the scores and steps per second
+ * With --bot player 2 is the computer, which is given all the time it asks for, so the match is no faster than it
+ * --step N advances N ticks per physics step, coarser but faster, collisions are swept so nothing is missed
+ * --checkpoint saves the match every N ticks (and at the end), and an existing checkpoint is picked up where it left off
+ */
+
+int headless_main(int argc, char *argv[]) {
+  const char *path = "-";
+  long max_ticks = 60L * 60 * TICK_RATE;
+  int n_players = 2;
+  int n_wells = 0;
+  double ship_mass = 0;
+  double theta = DEFAULT_THETA;
+  int torpedo_gravity = false;
+  int fixed_point = false;
+  int torpedoes = SHIP_TORPEDOES;
+  int arena_h = ARENA_H, arena_w = ARENA_W;
+  int step = 1;
+  const char *record = NULL;
+  const char *checkpoint = NULL;
+  long checkpoint_every = CHECKPOINT_INTERVAL;
+  NetConfig net_config = { 0, 7000, NULL, 0, 10, 0 };
+  int use_bot = false;
+  int bot_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int bot_ms = BOT_BUDGET_MS;
+
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--ticks") == 0 && i+1 < argc) { max_ticks = atol(argv[++i]); }
+    else if (strcmp(argv[i], "--ships") == 0 && i+1 < argc) { n_players = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--wells") == 0 && i+1 < argc) { n_wells = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--ship-mass") == 0 && i+1 < argc) { ship_mass = atof(argv[++i]); }
+    else if (strcmp(argv[i], "--theta") == 0 && i+1 < argc) { theta = atof(argv[++i]); }
+    else if (strcmp(argv[i], "--torpedo-gravity") == 0) { torpedo_gravity = true; }
+    else if (strcmp(argv[i], "--fixed") == 0) { fixed_point = true; }
+    else if (strcmp(argv[i], "--torpedoes") == 0 && i+1 < argc) { torpedoes = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--world") == 0 && i+1 < argc) {
+      if (!parse_world(argv[++i], &arena_h, &arena_w)) { return 1; }
+    }
+    else if (strcmp(argv[i], "--step") == 0 && i+1 < argc) { step = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--record") == 0 && i+1 < argc) { record = argv[++i]; }
+    else if (strcmp(argv[i], "--checkpoint") == 0 && i+1 < argc) { checkpoint = argv[++i]; }
+    else if (strcmp(argv[i], "--checkpoint-every") == 0 && i+1 < argc) { checkpoint_every = atol(argv[++i]); }
+    else if (strcmp(argv[i], "--net") == 0 && i+1 < argc) { net_config.player = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--port") == 0 && i+1 < argc) { net_config.port = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--peer") == 0 && i+1 < argc) { net_config.peer = argv[++i]; }
+    else if (strcmp(argv[i], "--input-delay") == 0 && i+1 < argc) { net_config.delay = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--rollback") == 0 && i+1 < argc) { net_config.window = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--latency") == 0 && i+1 < argc) { net_config.latency = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--bot") == 0) { use_bot = true; }
+    else if (strcmp(argv[i], "--bot-threads") == 0 && i+1 < argc) { bot_threads = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--bot-ms") == 0 && i+1 < argc) { bot_ms = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--simd") == 0 && i+1 < argc) {
+      if (!select_kernels(argv[++i])) {
+        fprintf(stderr, "%s kernels are not available on this machine\n", argv[i]);
+        return 1;
+      }
+    }
+    else { path = argv[i]; }
+  }
+
+  if (torpedoes < 1 || torpedoes > MAX_BULLETS) {
+    fprintf(stderr, "--torpedoes must be between 1 and %d\n", MAX_BULLETS);
+    return 1;
+  }
+  if (n_players < 2 || n_players > MAX_PLAYERS) {
+    fprintf(stderr, "--ships must be between 2 and %d\n", MAX_PLAYERS);
+    return 1;
+  }
+  // Replays and netplay both step one tick at a time, so only a plain run can take bigger steps
+  if (step < 1 || (step > 1 && (record || net_config.player))) {
+    fprintf(stderr, "--step must be at least 1, and 1 when recording or playing over the network\n");
+    return 1;
+  }
+
+  FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+  if (!file) {
+    perror(path);
+    return 1;
+  }
+
+  Script script;
+  int status = load_script(file, &script);
+  if (file != stdin) { fclose(file); }
+  if (status) { return 1; }
+
+  GameState game;
+  new_game(&game, n_players);
+  add_wells(&game, n_wells, 0.5);
+  if (arena_h != ARENA_H || arena_w != ARENA_W) { resize_arena(&game, arena_h, arena_w); }
+  game.ship_mass = ship_mass;
+  game.theta = theta;
+  game.torpedo_gravity = torpedo_gravity;
+  game.torpedo_limit = torpedoes;
+  if (fixed_point) { use_fixed_point(&game); }
+
+  // Resuming takes everything from the checkpoint, the options above only shape a new match
+  if (checkpoint && (net_config.player || checkpoint_every < 1)) {
+    fprintf(stderr, "--checkpoint can't be used with --net, and --checkpoint-every must be at least 1\n");
+    free_script(&script);
+    return 1;
+  }
+  if (checkpoint && access(checkpoint, F_OK) == 0) {
+    if (ckpt_load(checkpoint, &game) < 0) {
+      free_script(&script);
+      return 1;
+    }
+    printf("resumed from tick %d\n", game.tick);
+  }
+
+  if (net_config.player) {
+    if (n_players != 2 || (net_config.player != 1 && net_config.player != 2)) {
+      fprintf(stderr, "--net must be 1 or 2, with two ships\n");
+      free_script(&script);
+      return 1;
+    }
+    status = net_headless(&net_config, &script, &game, max_ticks);
+    free_script(&script);
+    return status;
+  }
+
+  Bot bot;
+  if (use_bot && bot_start(&bot, 1, bot_threads, bot_ms) < 0) {
+    free_script(&script);
+    return 1;
+  }
+
+  Recorder rec;
+  if (record && rec_open(&rec, record, &game, SNAPSHOT_INTERVAL) < 0) {
+    perror(record);
+    free_script(&script);
+    return 1;
+  }
+
+  Checkpoint ckpt;
+  if (checkpoint && ckpt_open(&ckpt, checkpoint) < 0) {
+    if (record) { rec_close(&rec, &game); }
+    free_script(&script);
+    return 1;
+  }
+  long saves = 0;
+  long long save_ns = 0;
+
+  // Script keys before the starting tick were used up by the run that saved the checkpoint
+  int next = 0;
+  long tick = game.tick;
+  int winner = check_winner(&game);
+  long first_tick = tick;
+  while (tick > 0 && next < script.count && script.events[next].time <= (tick-1) * 1000 / TICK_RATE) {
+    next++;
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
+  while (tick < max_ticks && !winner) {
+    long now = (tick + step-1) * 1000 / TICK_RATE;
+
+    // Gather this step's keys, anything past the 7 slots handle_game_inputs() reads waits a step
+    int keys_pressed[8];
+    int ch_num = 0;
+    while (next < script.count && script.events[next].time <= now && ch_num < 7) {
+      keys_pressed[ch_num++] = script.events[next++].key;
+    }
+    keys_pressed[ch_num] = ERR;
+
+    // The bot's ship ignores the script, and its decisions go in as keys so a recording can replay them
+    if (use_bot) {
+      bot_think_keys(&bot, &game, keys_pressed, tick % BOT_EVERY < step);
+    }
+
+    // There is no menu to return to, so pause requests are dropped
+    int pause_toggle = false;
+    if (record) { rec_keys(&rec, &game, keys_pressed); }
+    handle_game_inputs(&game, keys_pressed, &pause_toggle);
+    update_physics(&game, step);
+    if (record) { rec_tick(&rec, &game); }
+
+    winner = check_winner(&game);
+    tick += step;
+
+    if (checkpoint && tick % checkpoint_every < step) {
+      long long t = now_ns();
+      ckpt_save(&ckpt, &game);
+      save_ns += now_ns() - t;
+      saves++;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  printf("P1 SCORE  %05d       P2 SCORE  %05d\n", game.players[0].score, game.players[1].score);
+  if (winner) { printf("PLAYER %d WINS\n", winner); }
+  else        { printf("NO WINNER\n"); }
+  printf("ticks %ld (%.1fs game time) in %.3fs, %.0f steps/s (%s kernels)\n",
+    tick, (double)tick / TICK_RATE, seconds, seconds > 0 ? (tick - first_tick) / step / seconds : 0, game.fixed_point ? "Q16.16" : get_kernels()->name);
+
+  if (use_bot) {
+    bot_report(&bot, stdout);
+    bot_stop(&bot);
+  }
+  if (checkpoint) {
+    if (tick % checkpoint_every >= step) { ckpt_save(&ckpt, &game); }
+    ckpt_close(&ckpt);
+    printf("checkpoints %ld, %.1fus each\n", saves, saves ? save_ns / 1000.0 / saves : 0);
+  }
+
+  free_script(&script);
+  if (record && rec_close(&rec, &game) < 0) {
+    fprintf(stderr, "%s: failed to write the replay\n", record);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,22 @@
+#include "game.h"
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// A single scripted key press, timestamped in milliseconds of game time
+typedef struct KeyEvent {
+  long time;
+  int key;
+} KeyEvent;
+
+typedef struct Script {
+  KeyEvent *events;
+  int count, cap;
+} Script;
+
+int parse_key(const char *name);
+int load_script(FILE *file, Script *script);
+void free_script(Script *script);
+int headless_main(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,170 @@
+#include "hud.h"
+
+
+void hud_init(Hud *hud, Surface *surf, int player) {
+  hud->surf = surf;
+  hud->player = player;
+  hud_invalidate(hud);
+}
+
+// Forgets what every widget showed, so the next hud_update() draws them all
+void hud_invalidate(Hud *hud) {
+  hud->score = hud->weapon = hud->engine = hud->heat = hud->heading = hud->flame = HUD_UNDRAWN;
+  hud->speed = hud->travel = HUD_UNDRAWN;
+  hud->vely = hud->velx = NAN;
+}
+
+
+// The score box, five digits
+static int score_widget(Hud *hud, const Player *player) {
+  if (player->score == hud->score) { return false; }
+  hud->score = player->score;
+
+  surf_print(hud->surf, 2, 16, "%05d", player->score);
+  return true;
+}
+
+/* The weaponry box and the ! on the ship, 0 while the ship has a torpedo left to fire under its limit
+ * With none left it is 1 to 3 through each part of the newest torpedo's fuse
+ */
+static int weapon_widget(Hud *hud, const Player *player, const Bullet *newest, int limit) {
+  int weapon = player->torpedoes < limit ? 0 : !newest || newest->fuse > BULLET_FUSE/2 ? 1 : newest->fuse > BULLET_FUSE/4 ? 2 : 3;
+  if (weapon == hud->weapon) { return false; }
+  hud->weapon = weapon;
+
+  const char *tube[4][3] = {
+    { "╭╮", "├┤", "└┘" },
+    { "  ", "  ", "  " },
+    { "  ", "  ", "╭╮" },
+    { "  ", "╭╮", "├┤" },
+  };
+  surf_print(hud->surf, 7, 6, weapon ? "." : "!");
+  for (int row = 0; row < 3; row++) {
+    surf_print(hud->surf, 16+row, 19, "%s", tube[weapon][row]);
+  }
+  surf_print(hud->surf, 17, 23, weapon ? "     " : "READY");
+  return true;
+}
+
+// The engine box, on or off
+static int engine_widget(Hud *hud, const Player *player) {
+  if (player->acc == hud->engine) { return false; }
+  hud->engine = player->acc;
+
+  if (player->acc) {
+    surf_print(hud->surf, 7, 16, "MAIN ENGINES");
+    surf_print(hud->surf, 8, 16, " FULL POWER ");
+    surf_print(hud->surf, 9, 16, "! ! !╶╴! ! !");
+  }
+  else {
+    surf_print(hud->surf, 7, 16, "            ");
+    surf_print(hud->surf, 8, 16, "            ");
+    surf_print(hud->surf, 9, 16, "     ╶╴     ");
+  }
+  return true;
+}
+
+// The temperature bar, as how many of its 14 cells are lit, or -1 while the engine is overheated
+static int heat_widget(Hud *hud, const Player *player) {
+  int heat = 0;
+  for (int j = 0; j < 14; j++) {
+    if ((100/14)*j < player->temp) { heat++; }
+  }
+  if (player->temp < 0) { heat = -1; }
+  if (heat == hud->heat) { return false; }
+  hud->heat = heat;
+
+  if (heat < 0) {
+    surf_print(hud->surf, 12, 15, " ! OVERHEAT ! ");
+    return true;
+  }
+  for (int j = 0; j < 14; j++) {
+    surf_put(hud->surf, 12, 15+j, j < heat ? '|' : ' ');
+  }
+  return true;
+}
+
+// The heading box, which of the eight directions the ship faces
+static int heading_widget(Hud *hud, const Player *player) {
+  if (player->dir == hud->heading) { return false; }
+  hud->heading = player->dir;
+
+  surf_print(hud->surf, 16, 2, "· · ·");
+  surf_print(hud->surf, 17, 2, "· • ·");
+  surf_print(hud->surf, 18, 2, "· · ·");
+  surf_put(hud->surf, 17+round(thrust_vector(player->dir, Y)), 4+2*round(thrust_vector(player->dir, X)), charofdir(player->dir));
+  surf_print(hud->surf, 17, 9, "%03d°", player->dir * 45);
+  return true;
+}
+
+/* STATUS WIDGET
+ * The status readout, speed as a percentage and direction of travel in degrees, both to three decimal places
+ * Velocity only changes on a tick, so frames drawn between ticks don't even work out the square root and arctangent.
+ * When it has changed, each line is only rewritten if it has changed in thousandths, which is all the readout shows,
+ * and is printed from those thousandths so what is on screen always matches what was compared
+ */
+
+static int status_widget(Hud *hud, const Player *player) {
+  if (player->data.vely == hud->vely && player->data.velx == hud->velx) { return false; }
+  hud->vely = player->data.vely;
+  hud->velx = player->data.velx;
+  int drawn = false;
+
+  double vel = total_vel(player->data);
+  long speed = vel > 0.995 ? 100000 : lround(vel * 100 * 1000);
+  if (speed != hud->speed) {
+    hud->speed = speed;
+    surf_print(hud->surf, 23, 20, "%03ld.%03ld%%", speed / 1000, speed % 1000);
+    drawn = true;
+  }
+
+  long travel = lround(fmod(atan2(player->data.vely, player->data.velx) * 180/M_PI + 450, 360) * 1000);
+  if (travel != hud->travel) {
+    hud->travel = travel;
+    surf_print(hud->surf, 24, 20, "%03ld.%03ld°", travel / 1000, travel % 1000);
+    drawn = true;
+  }
+  return drawn;
+}
+
+// The flames under the ship in the visuals box, which flicker on their own timer of one glyph every FLAME_TICKS ticks
+static int flame_widget(Hud *hud, const Player *player, int tick) {
+  int flame = player->acc ? tick / FLAME_TICKS : -1;
+  if (flame == hud->flame) { return false; }
+  hud->flame = flame;
+
+  if (flame < 0) {
+    surf_print(hud->surf, 12, 4, "     ");
+  }
+  else if (hud->player == 1) {
+    surf_put(hud->surf, 12, 4, L"^\"*8°"[rand()%5]);
+    surf_put(hud->surf, 12, 8, L"^\"*8°"[rand()%5]);
+  }
+  else {
+    surf_put(hud->surf, 12, 6, L"^\"*8°"[rand()%5]);
+  }
+  return true;
+}
+
+
+/* HUD UPDATE
+ * Brings each of the widgets up to date with the game, and marks the surface to go out if any of them drew
+ * Returns whether anything was drawn
+ */
+
+int hud_update(Hud *hud, GameState *game) {
+  const Player *player = &game->players[hud->player-1];
+
+  int drawn = score_widget(hud, player);
+  drawn |= weapon_widget(hud, player, player_torpedo(game, hud->player-1), game->torpedo_limit);
+  drawn |= engine_widget(hud, player);
+  drawn |= heat_widget(hud, player);
+  drawn |= heading_widget(hud, player);
+  drawn |= status_widget(hud, player);
+  drawn |= flame_widget(hud, player, game->tick);
+
+  if (drawn) {
+    surf_refresh(hud->surf);
+  }
+  return drawn;
+}
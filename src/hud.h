@@ -0,0 +1,34 @@
+#include "render.h"
+
+#ifndef HUD_H
+#define HUD_H
+
+// The engine flames flicker to a new glyph once every this many ticks, however fast the screen is drawn
+#define FLAME_TICKS 4
+
+// What a widget remembers before it has drawn anything, no real value matches it so it always draws next frame
+#define HUD_UNDRAWN INT_MIN
+
+/* One player's HUD as a set of widgets drawn over the static parts create_ui() prints
+ * Each widget keeps the value it last showed, at the precision it shows it, and only writes cells when that changes
+ * so a frame where nothing on the HUD moved writes nothing. hud_invalidate() forgets them all, for when the
+ * surface has been reprinted or erased underneath them
+ */
+typedef struct Hud {
+  Surface *surf;
+  int player;
+  int score;
+  int weapon;
+  int engine;
+  int heat;
+  int heading;
+  int flame;
+  double vely, velx;
+  long speed, travel;
+} Hud;
+
+void hud_init(Hud *hud, Surface *surf, int player);
+void hud_invalidate(Hud *hud);
+int hud_update(Hud *hud, GameState *game);
+
+#endif
@@ -0,0 +1,134 @@
+#include "input.h"
+#include "sched.h"
+#include "term.h"
+#include <poll.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+
+
+// Queues one key, waiting for the game to make room rather than dropping it, returns false if told to stop meanwhile
+static int push(InputThread *input, int key, long long time) {
+  KeyRing *ring = &input->ring;
+  unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+  while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == INPUT_RING) {
+    struct pollfd stop = {input->stop[0], POLLIN, 0};
+    if (poll(&stop, 1, 1) > 0) { return false; }
+  }
+
+  ring->events[head % INPUT_RING] = (TimedKey){key, time};
+  atomic_store_explicit(&ring->head, head+1, memory_order_release);
+  return true;
+}
+
+
+/* INPUT MAIN
+ * Sleeps until the terminal has bytes (or we are told to stop), then decodes them and queues every key with its time
+ * Everything from one read gets the same time, they arrived together
+ * The end of input, or any error besides an interrupted call, ends the thread rather than polling it again forever
+ */
+
+static void *input_main(void *arg) {
+  InputThread *input = arg;
+
+  while (true) {
+    struct pollfd fds[2] = {{input->fd, POLLIN, 0}, {input->stop[0], POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) { continue; }
+      break;
+    }
+    if (fds[1].revents || fds[0].revents & (POLLERR | POLLNVAL)) {
+      break;
+    }
+
+    ssize_t got = read(input->fd, input->in + input->in_len, sizeof input->in - input->in_len);
+    if (got == 0) { break; }
+    if (got < 0) {
+      if (errno == EINTR || errno == EAGAIN) { continue; }
+      break;
+    }
+    long long time = now_ns();
+    input->in_len += got;
+
+    int keys[sizeof input->in];
+    int n = decode_keys(input->in, &input->in_len, keys, sizeof input->in);
+    for (int i = 0; i < n; i++) {
+      if (!push(input, keys[i], time)) { return NULL; }
+    }
+    if (n) {
+      uint64_t one = 1;
+      write(input->wake, &one, sizeof one);
+    }
+  }
+  return NULL;
+}
+
+
+// Starts reading keys from fd on their own thread, nothing else should read fd until input_stop()
+int input_start(InputThread *input, int fd) {
+  input->fd = fd;
+  input->in_len = 0;
+  atomic_init(&input->ring.head, 0);
+  atomic_init(&input->ring.tail, 0);
+
+  input->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (input->wake < 0) {
+    perror("eventfd");
+    return -1;
+  }
+  if (pipe(input->stop) < 0) {
+    perror("pipe");
+    close(input->wake);
+    return -1;
+  }
+  if (pthread_create(&input->thread, NULL, input_main, input) != 0) {
+    fprintf(stderr, "couldn't start the input thread\n");
+    close(input->wake);
+    close(input->stop[0]);
+    close(input->stop[1]);
+    return -1;
+  }
+  return 0;
+}
+
+void input_stop(InputThread *input) {
+  write(input->stop[1], "", 1);
+  pthread_join(input->thread, NULL);
+  close(input->wake);
+  close(input->stop[0]);
+  close(input->stop[1]);
+}
+
+
+// Clears the wakeup once the game has woken for it, anything still queued stays queued
+void input_ack(InputThread *input) {
+  uint64_t count;
+  read(input->wake, &count, sizeof count);
+}
+
+// The oldest key not yet taken, or NULL if there isn't one
+const TimedKey *input_peek(InputThread *input) {
+  KeyRing *ring = &input->ring;
+  unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  if (tail == atomic_load_explicit(&ring->head, memory_order_acquire)) {
+    return NULL;
+  }
+  return &ring->events[tail % INPUT_RING];
+}
+
+void input_pop(InputThread *input) {
+  KeyRing *ring = &input->ring;
+  atomic_store_explicit(&ring->tail, atomic_load_explicit(&ring->tail, memory_order_relaxed) + 1, memory_order_release);
+}
+
+// Takes up to max queued keys read before a given time, in the ERR terminated form handle_game_inputs() takes
+int input_take(InputThread *input, long long before, int keys[], int max) {
+  int n = 0;
+  const TimedKey *event;
+  while (n < max && (event = input_peek(input)) && event->time < before) {
+    keys[n++] = event->key;
+    input_pop(input);
+  }
+  keys[n] = ERR;
+  return n;
+}
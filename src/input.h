@@ -0,0 +1,45 @@
+#include "utils.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#ifndef INPUT_H
+#define INPUT_H
+
+// Key presses the reader can get ahead of the game by, a power of two so the ring indices just wrap
+#define INPUT_RING 256
+
+// One decoded key press, stamped with when it was read on the same clock as the scheduler (now_ns())
+typedef struct TimedKey {
+  int key;
+  long long time;
+} TimedKey;
+
+/* Single producer, single consumer ring of key presses, the reader thread writes head and the game reads tail
+ * Each index sits on its own cache line, so the two threads only share a line when one actually hands over events
+ */
+typedef struct KeyRing {
+  _Alignas(64) _Atomic unsigned head;
+  _Alignas(64) _Atomic unsigned tail;
+  TimedKey events[INPUT_RING];
+} KeyRing;
+
+/* A thread blocked on the terminal, decoding keys as soon as they arrive and queueing them with their time
+ * wake is an eventfd it bumps after queueing, for the game loop to sleep on in place of stdin
+ */
+typedef struct InputThread {
+  pthread_t thread;
+  int fd, wake;
+  int stop[2];
+  KeyRing ring;
+  unsigned char in[64];
+  int in_len;
+} InputThread;
+
+int input_start(InputThread *input, int fd);
+void input_stop(InputThread *input);
+void input_ack(InputThread *input);
+const TimedKey *input_peek(InputThread *input);
+void input_pop(InputThread *input);
+int input_take(InputThread *input, long long before, int keys[], int max);
+
+#endif
@@ -0,0 +1,404 @@
+#include "kernels.h"
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+  #define HAVE_X86_SIMD 1
+#endif
+
+
+// Makes sure there is room for n bodies, only ever growing the arrays
+void bodies_reserve(Bodies *bodies, int n) {
+  if (n > bodies->cap) {
+    bodies->cap = n*2;
+    bodies->y    = realloc(bodies->y,    bodies->cap * sizeof(double));
+    bodies->x    = realloc(bodies->x,    bodies->cap * sizeof(double));
+    bodies->vely = realloc(bodies->vely, bodies->cap * sizeof(double));
+    bodies->velx = realloc(bodies->velx, bodies->cap * sizeof(double));
+    bodies->ay   = realloc(bodies->ay,   bodies->cap * sizeof(double));
+    bodies->ax   = realloc(bodies->ax,   bodies->cap * sizeof(double));
+  }
+  bodies->n = n;
+}
+
+void bodies_free(Bodies *bodies) {
+  free(bodies->y);
+  free(bodies->x);
+  free(bodies->vely);
+  free(bodies->velx);
+  free(bodies->ay);
+  free(bodies->ax);
+  *bodies = (Bodies){0};
+}
+
+
+/* SCALAR KERNELS
+ * The reference versions, written over a range so the SIMD versions can use them for their leftover elements
+ */
+
+static void thrust_range(Bodies *b, int from, int to) {
+  for (int i = from; i < to; i++) {
+    b->vely[i] += b->ay[i];
+    b->velx[i] += b->ax[i];
+  }
+}
+
+// Pull towards a point mass at (wy, wx), strength is -2 for the original black hole
+static void gravity_range(Bodies *b, int from, int to, double wy, double wx, double strength, double d) {
+  for (int i = from; i < to; i++) {
+    double dy = b->y[i] - wy;
+    double dx = b->x[i] - wx;
+    double r2 = dy*dy + dx*dx;
+    double r = sqrt(r2);
+    double g = strength / r2;
+    b->vely[i] += g * (dy / r) * d;
+    b->velx[i] += g * (dx / r) * d;
+  }
+}
+
+static void cap_range(Bodies *b, int from, int to, double max) {
+  for (int i = from; i < to; i++) {
+    double vel = sqrt(b->vely[i]*b->vely[i] + b->velx[i]*b->velx[i]);
+    if (vel > max) {
+      b->vely[i] /= vel;
+      b->velx[i] /= vel;
+    }
+  }
+}
+
+static void integrate_range(Bodies *b, int from, int to, double d) {
+  for (int i = from; i < to; i++) {
+    b->y[i] += b->vely[i] * d;
+    b->x[i] += b->velx[i] * d;
+  }
+}
+
+static void wrap_range(Bodies *b, int from, int to, double top, double left, double height, double width) {
+  for (int i = from; i < to; i++) {
+    if (b->y[i] >= top+height) { b->y[i] -= height; }
+    else if (b->y[i] <= top) { b->y[i] += height; }
+    if (b->x[i] >= left+width) { b->x[i] -= width; }
+    else if (b->x[i] <= left) { b->x[i] += width; }
+  }
+}
+
+static void thrust_scalar(Bodies *b) { thrust_range(b, 0, b->n); }
+static void gravity_scalar(Bodies *b, double wy, double wx, double strength, double d) { gravity_range(b, 0, b->n, wy, wx, strength, d); }
+static void cap_scalar(Bodies *b, double max) { cap_range(b, 0, b->n, max); }
+static void integrate_scalar(Bodies *b, double d) { integrate_range(b, 0, b->n, d); }
+static void wrap_scalar(Bodies *b, double top, double left, double height, double width) { wrap_range(b, 0, b->n, top, left, height, width); }
+
+static const Kernels scalar_kernels = {"scalar", thrust_scalar, gravity_scalar, cap_scalar, integrate_scalar, wrap_scalar};
+
+
+#ifdef HAVE_X86_SIMD
+
+/* SSE2 KERNELS
+ * Two bodies at a time
+ */
+
+__attribute__((target("sse2")))
+static void thrust_sse2(Bodies *b) {
+  int i = 0;
+  for (; i+2 <= b->n; i += 2) {
+    _mm_storeu_pd(b->vely+i, _mm_add_pd(_mm_loadu_pd(b->vely+i), _mm_loadu_pd(b->ay+i)));
+    _mm_storeu_pd(b->velx+i, _mm_add_pd(_mm_loadu_pd(b->velx+i), _mm_loadu_pd(b->ax+i)));
+  }
+  thrust_range(b, i, b->n);
+}
+
+__attribute__((target("sse2")))
+static void gravity_sse2(Bodies *b, double wy, double wx, double strength, double d) {
+  __m128d vwy = _mm_set1_pd(wy), vwx = _mm_set1_pd(wx);
+  __m128d vs = _mm_set1_pd(strength), vd = _mm_set1_pd(d);
+  int i = 0;
+  for (; i+2 <= b->n; i += 2) {
+    __m128d dy = _mm_sub_pd(_mm_loadu_pd(b->y+i), vwy);
+    __m128d dx = _mm_sub_pd(_mm_loadu_pd(b->x+i), vwx);
+    __m128d r2 = _mm_add_pd(_mm_mul_pd(dy, dy), _mm_mul_pd(dx, dx));
+    __m128d r = _mm_sqrt_pd(r2);
+    __m128d g = _mm_div_pd(vs, r2);
+    __m128d ay = _mm_mul_pd(_mm_mul_pd(g, _mm_div_pd(dy, r)), vd);
+    __m128d ax = _mm_mul_pd(_mm_mul_pd(g, _mm_div_pd(dx, r)), vd);
+    _mm_storeu_pd(b->vely+i, _mm_add_pd(_mm_loadu_pd(b->vely+i), ay));
+    _mm_storeu_pd(b->velx+i, _mm_add_pd(_mm_loadu_pd(b->velx+i), ax));
+  }
+  gravity_range(b, i, b->n, wy, wx, strength, d);
+}
+
+__attribute__((target("sse2")))
+static void cap_sse2(Bodies *b, double max) {
+  __m128d vmax = _mm_set1_pd(max);
+  int i = 0;
+  for (; i+2 <= b->n; i += 2) {
+    __m128d vy = _mm_loadu_pd(b->vely+i);
+    __m128d vx = _mm_loadu_pd(b->velx+i);
+    __m128d vel = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(vy, vy), _mm_mul_pd(vx, vx)));
+    __m128d over = _mm_cmpgt_pd(vel, vmax);
+    vy = _mm_or_pd(_mm_and_pd(over, _mm_div_pd(vy, vel)), _mm_andnot_pd(over, vy));
+    vx = _mm_or_pd(_mm_and_pd(over, _mm_div_pd(vx, vel)), _mm_andnot_pd(over, vx));
+    _mm_storeu_pd(b->vely+i, vy);
+    _mm_storeu_pd(b->velx+i, vx);
+  }
+  cap_range(b, i, b->n, max);
+}
+
+__attribute__((target("sse2")))
+static void integrate_sse2(Bodies *b, double d) {
+  __m128d vd = _mm_set1_pd(d);
+  int i = 0;
+  for (; i+2 <= b->n; i += 2) {
+    _mm_storeu_pd(b->y+i, _mm_add_pd(_mm_loadu_pd(b->y+i), _mm_mul_pd(_mm_loadu_pd(b->vely+i), vd)));
+    _mm_storeu_pd(b->x+i, _mm_add_pd(_mm_loadu_pd(b->x+i), _mm_mul_pd(_mm_loadu_pd(b->velx+i), vd)));
+  }
+  integrate_range(b, i, b->n, d);
+}
+
+// Both wrapped values are worked out from the original position, then the masks pick one (or neither)
+__attribute__((target("sse2")))
+static __m128d wrap_axis_sse2(__m128d p, __m128d low, __m128d high, __m128d size) {
+  __m128d above = _mm_cmpge_pd(p, high);
+  __m128d below = _mm_andnot_pd(above, _mm_cmple_pd(p, low));
+  __m128d shift = _mm_or_pd(_mm_and_pd(above, _mm_sub_pd(p, size)), _mm_and_pd(below, _mm_add_pd(p, size)));
+  return _mm_or_pd(shift, _mm_andnot_pd(_mm_or_pd(above, below), p));
+}
+
+__attribute__((target("sse2")))
+static void wrap_sse2(Bodies *b, double top, double left, double height, double width) {
+  __m128d vtop = _mm_set1_pd(top), vbottom = _mm_set1_pd(top+height), vh = _mm_set1_pd(height);
+  __m128d vleft = _mm_set1_pd(left), vright = _mm_set1_pd(left+width), vw = _mm_set1_pd(width);
+  int i = 0;
+  for (; i+2 <= b->n; i += 2) {
+    _mm_storeu_pd(b->y+i, wrap_axis_sse2(_mm_loadu_pd(b->y+i), vtop, vbottom, vh));
+    _mm_storeu_pd(b->x+i, wrap_axis_sse2(_mm_loadu_pd(b->x+i), vleft, vright, vw));
+  }
+  wrap_range(b, i, b->n, top, left, height, width);
+}
+
+static const Kernels sse2_kernels = {"sse2", thrust_sse2, gravity_sse2, cap_sse2, integrate_sse2, wrap_sse2};
+
+
+/* AVX2 KERNELS
+ * Four bodies at a time, deliberately without FMA so rounding matches the scalar versions
+ */
+
+__attribute__((target("avx2")))
+static void thrust_avx2(Bodies *b) {
+  int i = 0;
+  for (; i+4 <= b->n; i += 4) {
+    _mm256_storeu_pd(b->vely+i, _mm256_add_pd(_mm256_loadu_pd(b->vely+i), _mm256_loadu_pd(b->ay+i)));
+    _mm256_storeu_pd(b->velx+i, _mm256_add_pd(_mm256_loadu_pd(b->velx+i), _mm256_loadu_pd(b->ax+i)));
+  }
+  thrust_range(b, i, b->n);
+}
+
+__attribute__((target("avx2")))
+static void gravity_avx2(Bodies *b, double wy, double wx, double strength, double d) {
+  __m256d vwy = _mm256_set1_pd(wy), vwx = _mm256_set1_pd(wx);
+  __m256d vs = _mm256_set1_pd(strength), vd = _mm256_set1_pd(d);
+  int i = 0;
+  for (; i+4 <= b->n; i += 4) {
+    __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(b->y+i), vwy);
+    __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(b->x+i), vwx);
+    __m256d r2 = _mm256_add_pd(_mm256_mul_pd(dy, dy), _mm256_mul_pd(dx, dx));
+    __m256d r = _mm256_sqrt_pd(r2);
+    __m256d g = _mm256_div_pd(vs, r2);
+    __m256d ay = _mm256_mul_pd(_mm256_mul_pd(g, _mm256_div_pd(dy, r)), vd);
+    __m256d ax = _mm256_mul_pd(_mm256_mul_pd(g, _mm256_div_pd(dx, r)), vd);
+    _mm256_storeu_pd(b->vely+i, _mm256_add_pd(_mm256_loadu_pd(b->vely+i), ay));
+    _mm256_storeu_pd(b->velx+i, _mm256_add_pd(_mm256_loadu_pd(b->velx+i), ax));
+  }
+  gravity_range(b, i, b->n, wy, wx, strength, d);
+}
+
+__attribute__((target("avx2")))
+static void cap_avx2(Bodies *b, double max) {
+  __m256d vmax = _mm256_set1_pd(max);
+  int i = 0;
+  for (; i+4 <= b->n; i += 4) {
+    __m256d vy = _mm256_loadu_pd(b->vely+i);
+    __m256d vx = _mm256_loadu_pd(b->velx+i);
+    __m256d vel = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(vy, vy), _mm256_mul_pd(vx, vx)));
+    __m256d over = _mm256_cmp_pd(vel, vmax, _CMP_GT_OQ);
+    _mm256_storeu_pd(b->vely+i, _mm256_blendv_pd(vy, _mm256_div_pd(vy, vel), over));
+    _mm256_storeu_pd(b->velx+i, _mm256_blendv_pd(vx, _mm256_div_pd(vx, vel), over));
+  }
+  cap_range(b, i, b->n, max);
+}
+
+__attribute__((target("avx2")))
+static void integrate_avx2(Bodies *b, double d) {
+  __m256d vd = _mm256_set1_pd(d);
+  int i = 0;
+  for (; i+4 <= b->n; i += 4) {
+    _mm256_storeu_pd(b->y+i, _mm256_add_pd(_mm256_loadu_pd(b->y+i), _mm256_mul_pd(_mm256_loadu_pd(b->vely+i), vd)));
+    _mm256_storeu_pd(b->x+i, _mm256_add_pd(_mm256_loadu_pd(b->x+i), _mm256_mul_pd(_mm256_loadu_pd(b->velx+i), vd)));
+  }
+  integrate_range(b, i, b->n, d);
+}
+
+__attribute__((target("avx2")))
+static __m256d wrap_axis_avx2(__m256d p, __m256d low, __m256d high, __m256d size) {
+  __m256d above = _mm256_cmp_pd(p, high, _CMP_GE_OQ);
+  __m256d below = _mm256_cmp_pd(p, low, _CMP_LE_OQ);
+  p = _mm256_blendv_pd(p, _mm256_add_pd(p, size), below);
+  return _mm256_blendv_pd(p, _mm256_sub_pd(p, size), above);
+}
+
+__attribute__((target("avx2")))
+static void wrap_avx2(Bodies *b, double top, double left, double height, double width) {
+  __m256d vtop = _mm256_set1_pd(top), vbottom = _mm256_set1_pd(top+height), vh = _mm256_set1_pd(height);
+  __m256d vleft = _mm256_set1_pd(left), vright = _mm256_set1_pd(left+width), vw = _mm256_set1_pd(width);
+  int i = 0;
+  for (; i+4 <= b->n; i += 4) {
+    _mm256_storeu_pd(b->y+i, wrap_axis_avx2(_mm256_loadu_pd(b->y+i), vtop, vbottom, vh));
+    _mm256_storeu_pd(b->x+i, wrap_axis_avx2(_mm256_loadu_pd(b->x+i), vleft, vright, vw));
+  }
+  wrap_range(b, i, b->n, top, left, height, width);
+}
+
+static const Kernels avx2_kernels = {"avx2", thrust_avx2, gravity_avx2, cap_avx2, integrate_avx2, wrap_avx2};
+
+#endif
+
+
+static const Kernels *active_kernels = NULL;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+// The best kernels the CPU supports, worked out in a local and stored once so no thread ever sees a half made choice
+static void pick_kernels() {
+  const Kernels *best = &scalar_kernels;
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))      { best = &avx2_kernels; }
+  else if (__builtin_cpu_supports("sse2")) { best = &sse2_kernels; }
+#endif
+  active_kernels = best;
+}
+
+// Returns the kernels in use, picking the best the CPU supports the first time any thread calls it
+const Kernels *get_kernels() {
+  pthread_once(&kernels_once, pick_kernels);
+  return active_kernels;
+}
+
+// Forces a particular set of kernels by name, returns false if it isn't available on this machine
+// Call it before any other thread starts, after the automatic pick so that can never replace it
+int select_kernels(const char *name) {
+  pthread_once(&kernels_once, pick_kernels);
+  if (strcmp(name, "scalar") == 0) { active_kernels = &scalar_kernels; return true; }
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2")) { active_kernels = &sse2_kernels; return true; }
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) { active_kernels = &avx2_kernels; return true; }
+#endif
+  return false;
+}
+
+
+// A double spread evenly over [low, high)
+static double random_between(uint64_t *rng, double low, double high) {
+  return low + (next_random(rng) >> 11) * 0x1.0p-53 * (high - low);
+}
+
+static void copy_bodies(Bodies *dst, const Bodies *src) {
+  bodies_reserve(dst, src->n);
+  double *to[] = { dst->y, dst->x, dst->vely, dst->velx, dst->ay, dst->ax };
+  double *from[] = { src->y, src->x, src->vely, src->velx, src->ay, src->ax };
+  for (int a = 0; a < 6; a++) {
+    memcpy(to[a], from[a], src->n * sizeof(double));
+  }
+}
+
+static int same_bodies(const Bodies *a, const Bodies *b) {
+  const double *one[] = { a->y, a->x, a->vely, a->velx, a->ay, a->ax };
+  const double *two[] = { b->y, b->x, b->vely, b->velx, b->ay, b->ax };
+  for (int i = 0; i < 6; i++) {
+    if (memcmp(one[i], two[i], a->n * sizeof(double)) != 0) { return false; }
+  }
+  return true;
+}
+
+
+/* CHECK KERNELS MAIN
+ * Usage: spacewar --check-kernels [--rounds N] [--seed S]
+ * Runs every set of kernels this CPU has over the same random bodies as the scalar reference, each kernel starting
+ * from the same bodies, and compares what each leaves behind byte for byte. Sizes go from 0 up past several vector widths so the
+ * leftover elements are checked too. Bodies go anywhere in and around the arena, some exactly on its edges, and
+ * some fast enough to be capped
+ */
+
+int check_kernels_main(int argc, char *argv[]) {
+  long rounds = 2000;
+  uint64_t rng = 1;
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--rounds") == 0 && i+1 < argc)    { rounds = atol(argv[++i]); }
+    else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) { rng = strtoull(argv[++i], NULL, 10); }
+  }
+
+  const Kernels *sets[3] = { &scalar_kernels };
+  int n_sets = 1;
+#ifdef HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) { sets[n_sets++] = &sse2_kernels; }
+  if (__builtin_cpu_supports("avx2")) { sets[n_sets++] = &avx2_kernels; }
+#endif
+
+  const char *kernel_names[] = { "thrust", "gravity", "cap", "integrate", "wrap" };
+  const double top = 1, left = 1, height = 40, width = 120;
+  Bodies start = {0}, want = {0}, got = {0};
+  int failed = false;
+
+  for (long round = 0; round < rounds && !failed; round++) {
+    int n = round % 41;
+    bodies_reserve(&start, n);
+    for (int i = 0; i < n; i++) {
+      start.y[i] = random_between(&rng, top - 10, top + height + 10);
+      start.x[i] = random_between(&rng, left - 10, left + width + 10);
+      if (next_random(&rng) % 8 == 0) { start.y[i] = next_random(&rng) % 2 ? top : top + height; }
+      if (next_random(&rng) % 8 == 0) { start.x[i] = next_random(&rng) % 2 ? left : left + width; }
+      start.vely[i] = random_between(&rng, -1.5, 1.5);
+      start.velx[i] = random_between(&rng, -1.5, 1.5);
+      start.ay[i] = random_between(&rng, -0.1, 0.1);
+      start.ax[i] = random_between(&rng, -0.1, 0.1);
+    }
+    double wy = random_between(&rng, top, top + height);
+    double wx = random_between(&rng, left, left + width);
+    double strength = -2 * random_between(&rng, 0.5, 4);
+    double d = random_between(&rng, 0.1, 1);
+
+    for (int s = 1; s < n_sets && !failed; s++) {
+      for (int kernel = 0; kernel < 5 && !failed; kernel++) {
+        copy_bodies(&want, &start);
+        copy_bodies(&got, &start);
+        const Kernels *pair[2] = { &scalar_kernels, sets[s] };
+        Bodies *bodies[2] = { &want, &got };
+        for (int p = 0; p < 2; p++) {
+          switch (kernel) {
+            case 0: pair[p]->thrust(bodies[p]); break;
+            case 1: pair[p]->gravity(bodies[p], wy, wx, strength, d); break;
+            case 2: pair[p]->cap(bodies[p], 1); break;
+            case 3: pair[p]->integrate(bodies[p], d); break;
+            case 4: pair[p]->wrap(bodies[p], top, left, height, width); break;
+          }
+        }
+        if (!same_bodies(&want, &got)) {
+          printf("%s %s differs from scalar with %d bodies on round %ld: FAILED\n", sets[s]->name, kernel_names[kernel], n, round);
+          failed = true;
+        }
+      }
+    }
+  }
+
+  if (!failed) {
+    printf("%ld rounds of", rounds);
+    for (int s = 0; s < n_sets; s++) {
+      printf(" %s", sets[s]->name);
+    }
+    printf(" kernels, every result identical to scalar: ok\n");
+  }
+  bodies_free(&start);
+  bodies_free(&want);
+  bodies_free(&got);
+  return failed ? 1 : 0;
+}
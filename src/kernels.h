@@ -0,0 +1,34 @@
+#include "utils.h"
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+/* Structure of arrays copy of a set of moving objects, for the vectorised physics kernels
+ * ay/ax hold a velocity change to add this step (engine thrust), the rest mirror ObjectData
+ */
+typedef struct Bodies {
+  int n, cap;
+  double *y, *x;
+  double *vely, *velx;
+  double *ay, *ax;
+} Bodies;
+
+/* One implementation of every physics kernel, picked once at runtime for the best instruction set the CPU has
+ * All of them do the same IEEE operations in the same order, so they give bit for bit identical results
+ */
+typedef struct Kernels {
+  const char *name;
+  void (*thrust)(Bodies *bodies);
+  void (*gravity)(Bodies *bodies, double wy, double wx, double strength, double d);
+  void (*cap)(Bodies *bodies, double max);
+  void (*integrate)(Bodies *bodies, double d);
+  void (*wrap)(Bodies *bodies, double top, double left, double height, double width);
+} Kernels;
+
+void bodies_reserve(Bodies *bodies, int n);
+void bodies_free(Bodies *bodies);
+const Kernels *get_kernels();
+int select_kernels(const char *name);
+int check_kernels_main(int argc, char *argv[]);
+
+#endif
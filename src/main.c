@@ -1,16 +1,22 @@
-#include "utils.h"
-
-#define PHYSICS_SPEED 1.0
-#define FRAMERATE 50
-
-#define P1_Y 76.5
-#define P1_X 25.5
-#define P2_Y 26.5
-#define P2_X 75.5
-
-#define WIN_H 51
-#define WIN_W 101
-#define UI_SIZE 30
+#include "game.h"
+#include "headless.h"
+#include "batch.h"
+#include "sched.h"
+#include "render.h"
+#include "hud.h"
+#include "replay.h"
+#include "net.h"
+#include "spectate.h"
+#include "prof.h"
+#include "fixed.h"
+#include "checkpoint.h"
+#include "kernels.h"
+#include "bench.h"
+#include "input.h"
+#include "bot.h"
+#include "sim.h"
+#include "cast.h"
+#include <poll.h>
 
 /* SETUP
  * Calls all required functions for ncurses setup so the screen displays correctly
@@ -38,31 +44,33 @@ void setup() {
 }
 
 
-void draw_ship(WINDOW *win, int y, int x, int player) {
+void draw_ship(Surface *win, int y, int x, int player) {
   if (player == 1) {
-    mvwprintw(win, y+0, x, "  /!\\  ");
-    mvwprintw(win, y+1, x, " (   ) ");
-    mvwprintw(win, y+2, x, " / θ \\");
-    mvwprintw(win, y+3, x, "( ___ )");
-    mvwprintw(win, y+4, x, "/_\\ /_\\");
+    surf_print(win, y+0, x, "  /!\\  ");
+    surf_print(win, y+1, x, " (   ) ");
+    surf_print(win, y+2, x, " / θ \\");
+    surf_print(win, y+3, x, "( ___ )");
+    surf_print(win, y+4, x, "/_\\ /_\\");
   }
   else {
-    mvwprintw(win, y+0, x, " __!__ ");
-    mvwprintw(win, y+1, x, "(_   _)");
-    mvwprintw(win, y+2, x, "  |θ|  ");
-    mvwprintw(win, y+3, x, "  ( )  ");
-    mvwprintw(win, y+4, x, "  /_\\ ");
+    surf_print(win, y+0, x, " __!__ ");
+    surf_print(win, y+1, x, "(_   _)");
+    surf_print(win, y+2, x, "  |θ|  ");
+    surf_print(win, y+3, x, "  ( )  ");
+    surf_print(win, y+4, x, "  /_\\ ");
   }
 }
 
 
 /* CREATE UI
  * Prints the static parts of the players' HUDs, so they don't have to be reprinted every frame
- * Also includes the player specific spaceship for the visuals section
+ * Also includes the player specific spaceship for the visuals section, and leaves the widgets to draw over it all next frame
  */
 
-void create_ui(WINDOW *ui, int player) {
-  mvwprintw(ui, 0, 0,
+void create_ui(Hud *hud) {
+  Surface *ui = hud->surf;
+  int player = hud->player;
+  surf_print(ui, 0, 0,
     "┌────────┤ PLAYER %d ├────────┐"
     "│ ┌──┐                  ┌──┐ │"
     "│ │()│  SCORE  [     ]  │()│ │"
@@ -93,296 +101,104 @@ void create_ui(WINDOW *ui, int player) {
     , player);
 
   draw_ship(ui, 7, 3, player);
-  
-  wrefresh(ui);
-}
-
+  hud_invalidate(hud);
 
-// Automates resetting the players position when they are destroyed
-void destroy(Player *player) {
-  if (player->type == PLAYER1) {
-    *player = new_player(PLAYER1, P1_Y, P1_X, NW, player->score-50);
-  }
-  else if (player->type == PLAYER2) {
-    *player = new_player(PLAYER2, P2_Y, P2_X, SE, player->score-50);
-  }
+  surf_refresh(ui);
+  surf_present(ui);
 }
 
 
-/* UPDATE PHYSICS
- * Steps all physics on each frame, with delta since last frame to correct for frametime differences
- */
-
-void update_physics(GameState *game, int delta, int frame) {
-  double d = (double)delta/33333333.3 * PHYSICS_SPEED;
-
-  for (int i=0; i < 2; i++) {
-
-    // Calculate the new positions of the colour trails
-    if (frame%4 == 0) {
-      shift_trails(&game->players[i].data);
-      shift_trails(&game->bullets[i].data);
-    }
-
-    // Check for overheating and calculate temperature & engine acceleration
-    if (game->players[i].temp > 100) {
-      game->players[i].acc = false;
-      game->players[i].temp = -100;
-    }
-    else if (game->players[i].temp < 0) {
-      game->players[i].temp += d;
-    }
-    else if (!game->players[i].acc) {
-      game->players[i].temp -= d/2;
-      if (game->players[i].temp < 0) { game->players[i].temp = 0; }
-    }
-    else {
-      game->players[i].data.vely += 0.005 * thrust_vector(game->players[i].dir, Y) * d;
-      game->players[i].data.velx += 0.005 * thrust_vector(game->players[i].dir, X) * d;
-      game->players[i].temp += d/2;
-    }
-
-    // Gravity calculations for the black hole
-    double dy = game->players[i].data.y - game->bh.y;
-    double dx = game->players[i].data.x - game->bh.x;
-    double r2 = total_dist_squared(dy, dx);
-    double r = sqrt(r2);
-    double g = -2 / r2;
-    double unity = dy / r;
-    double unitx = dx / r;
-    game->players[i].data.vely += g * unity * d;
-    game->players[i].data.velx += g * unitx * d;
-
-    if (r < 1) {
-      destroy(&game->players[i]);
-    }
-
-    // Destroy players ships if they've crashed into each other
-    dy = game->players[i].data.y - game->players[1-i].data.y;
-    dx = game->players[i].data.x - game->players[1-i].data.x;
-    r = sqrt(total_dist_squared(dy, dx));
-    if (r < 2) {
-      destroy(&game->players[i]);
-      destroy(&game->players[1-i]);
-    }
-
-    // Cap players velocity at 1
-    double velxy = total_vel(game->players[i].data);
-    if (velxy > 1) {
-      game->players[i].data.vely /= velxy;
-      game->players[i].data.velx /= velxy;
-    }
-
-    // Update position with new velocity
-    game->players[i].data.y += game->players[i].data.vely * d;
-    game->players[i].data.x += game->players[i].data.velx * d;
-
-    // Move ship to opposite side of screen if it goes off the edge
-    if (game->players[i].data.y >= 2*WIN_H-2) { game->players[i].data.y -= 2*WIN_H-4; }
-    else if (game->players[i].data.y <= 2) { game->players[i].data.y += 2*WIN_H-4; }
-    if (game->players[i].data.x >= WIN_W-1) { game->players[i].data.x -= WIN_W-2; }
-    else if (game->players[i].data.x <= 1) { game->players[i].data.x += WIN_W-2; }
-
-
-    if (game->bullets[i].type == BULLET) {
-      game->bullets[i].data.y += game->bullets[i].data.vely * d;
-      game->bullets[i].data.x += game->bullets[i].data.velx * d;
-
-      if (game->bullets[i].data.y >= 2*WIN_H-2) { game->bullets[i].data.y -= 2*WIN_H-4; }
-      else if (game->bullets[i].data.y <= 2) { game->bullets[i].data.y += 2*WIN_H-4; }
-      if (game->bullets[i].data.x >= WIN_W-1) { game->bullets[i].data.x -= WIN_W-2; }
-      else if (game->bullets[i].data.x <= 1) { game->bullets[i].data.x += WIN_W-2; }
-
-      // Check if a bullet has hit a ship and update positions & score
-      for (int j=0; j<=1; j++) {
-        double dy = game->bullets[i].data.y - game->players[j].data.y;
-        double dx = game->bullets[i].data.x - game->players[j].data.x;
-        double r = sqrt(total_dist_squared(dy, dx));
-        if (r < 2) {
-          destroy(&game->players[j]);
-          game->bullets[i] = err_bullet();
-          game->players[1-j].score += 250;
-        }
-      }
 
-      // Destroy bullets if they've crashed into each other
-      dy = game->bullets[i].data.y - game->bullets[1-i].data.y;
-      dx = game->bullets[i].data.x - game->bullets[1-i].data.x;
-      r = sqrt(total_dist_squared(dy, dx));
-      if (r < 2) {
-        game->bullets[i] = err_bullet();
-        game->bullets[1-i] = err_bullet();
-      }
 
-      // Destroy bullet after certain amount of time
-      game->bullets[i].fuse -= delta;
-      if (game->bullets[i].fuse < 0) {
-        game->bullets[i] = err_bullet();
-      }
-    }
+// Queues the point in an object's trail from a given number of shifts ago, age 0 being where it is now
+// Points the camera can't see are culled here, before they cost the view anything
+void draw_trail(ArenaView *view, const Camera *cam, ObjectData *data, int age, wchar_t ch, int colour) {
+  const double trail[4][2] = { {data->y, data->x}, {data->y1, data->x1}, {data->y2, data->x2}, {data->y3, data->x3} };
+  int row, col;
+  if (camera_cell(cam, trail[age][0], trail[age][1], &row, &col)) {
+    view_put(view, row, col, ch, colour);
   }
 }
 
 
 /* UPDATE SCREEN
- * Clears game screen and redraws new positions of all game objects
- * Updates dynamic parts of HUDs, including animations and status indicators
+ * Redraws new positions of all game objects, only touching the cells that changed since last frame
+ * Only what the camera can see is drawn, so in a big arena the cost depends on the window and not the arena
+ * Updates the dynamic parts of the HUDs, whose widgets only draw what changed too
+ * Nothing reaches the terminal until the caller presents, so anything else drawn that frame goes out with it
  */
 
-void update_screen(WINDOW *win, WINDOW *ui1, WINDOW *ui2, GameState game) {
-  WINDOW *ui[] = { ui1, ui2 };
-  werase(win);
-
-  for (int i=0; i < 2; i++) {
-    wcolour(win, 3);
-    mvwprintw(win, (game.players[i].data.y3)/2, game.players[i].data.x3, "%lc", charoftype(game.players[i].type));
-    mvwprintw(win, (game.bullets[i].data.y3)/2, game.bullets[i].data.x3, "%lc", charoftype(game.bullets[i].type));
-    wcolour(win, 2);
-    mvwprintw(win, (game.players[i].data.y2)/2, game.players[i].data.x2, "%lc", charoftype(game.players[i].type));
-    mvwprintw(win, (game.players[i].data.y1)/2, game.players[i].data.x1, "%lc", charoftype(game.players[i].type));
-    mvwprintw(win, (game.bullets[i].data.y2)/2, game.bullets[i].data.x2, "%lc", charoftype(game.bullets[i].type));
-    mvwprintw(win, (game.bullets[i].data.y1)/2, game.bullets[i].data.x1, "%lc", charoftype(game.bullets[i].type));
-    wcolour(win, 1);
-    mvwprintw(win, (game.players[i].data.y)/2, game.players[i].data.x, "%lc", charoftype(game.players[i].type));
-    mvwprintw(win, (game.bullets[i].data.y)/2, game.bullets[i].data.x, "%lc", charoftype(game.bullets[i].type));
-  }
-  
-  mvwprintw(win, game.bh.y / 2, game.bh.x, "%lc", charoftype(BLACKHOLE));
-
-  box(win, 0, 0);
-  mvwprintw(win, 0, 4, "┤ SPACEWAR! ├");
-
-  wnoutrefresh(win);
-
-  for (int i=0; i<2; i++) {
-    mvwprintw(ui[i], 2, 16, "%05d", game.players[i].score);
-
-    if (game.bullets[i].type == ERR) {
-      mvwprintw(ui[i], 7, 6, "!");
-      mvwprintw(ui[i], 16, 19, "╭╮");
-      mvwprintw(ui[i], 17, 19, "├┤");
-      mvwprintw(ui[i], 18, 19, "└┘");
-      mvwprintw(ui[i], 17, 23, "READY");
-    }
-    else {
-      if (game.bullets[i].fuse > INT_MAX/2) {
-        mvwprintw(ui[i], 7, 6, ".");
-        mvwprintw(ui[i], 16, 19, "  ");
-        mvwprintw(ui[i], 17, 19, "  ");
-        mvwprintw(ui[i], 18, 19, "  ");
-        mvwprintw(ui[i], 17, 23, "     ");
-      }
-      else if (game.bullets[i].fuse > INT_MAX/4) {
-        mvwprintw(ui[i], 7, 6, ".");
-        mvwprintw(ui[i], 16, 19, "  ");
-        mvwprintw(ui[i], 17, 19, "  ");
-        mvwprintw(ui[i], 18, 19, "╭╮");
-        mvwprintw(ui[i], 17, 23, "     ");
-      }
-      else {
-        mvwprintw(ui[i], 7, 6, ".");
-        mvwprintw(ui[i], 16, 19, "  ");
-        mvwprintw(ui[i], 17, 19, "╭╮");
-        mvwprintw(ui[i], 18, 19, "├┤");
-        mvwprintw(ui[i], 17, 23, "     ");
-      }
-    }
+void update_screen(ArenaView *view, Camera *cam, Hud *hud1, Hud *hud2, GameState *game) {
+  camera_follow(cam, game, view);
+  view_begin(view);
 
-    if (game.players[i].acc) {
-      mvwprintw(ui[i], 7, 16, "MAIN ENGINES");
-      mvwprintw(ui[i], 8, 16, " FULL POWER ");
-      mvwprintw(ui[i], 9, 16, "! ! !╶╴! ! !");
-    }
-    else {
-      mvwprintw(ui[i], 7, 16, "            ");
-      mvwprintw(ui[i], 8, 16, "            ");
-      mvwprintw(ui[i], 9, 16, "     ╶╴     ");
-      mvwprintw(ui[i], 12,  4, "     ");
+  // Oldest trail positions first in the dimmest colour, so the objects themselves end up on top
+  int colours[] = { 1, 2, 2, 3 };
+  for (int age = 3; age >= 0; age--) {
+    for (int i=0; i < game->n_players; i++) {
+      draw_trail(view, cam, &game->players[i].data, age, charoftype(game->players[i].type), colours[age]);
     }
-
-    for (int j = 0; j < 14; j++) {
-      if ((100/14)*j < game.players[i].temp) { mvwaddch(ui[i], 12, 15+j, '|'); }
-      else { mvwaddch(ui[i], 12, 15+j, ' '); }
+    for (int a=0; a < game->n_alive; a++) {
+      draw_trail(view, cam, &game->bullets[game->alive[a]].data, age, charoftype(BULLET), colours[age]);
     }
-
-    if (game.players[i].temp < 0) {
-      mvwprintw(ui[i], 12, 15, " ! OVERHEAT ! ");
-    }
-
-    mvwprintw(ui[i], 16, 2, "· · ·");
-    mvwprintw(ui[i], 17, 2, "· • ·");
-    mvwprintw(ui[i], 18, 2, "· · ·");
-
-    mvwprintw(ui[i], 17+round(thrust_vector(game.players[i].dir, Y)), 4+2*round(thrust_vector(game.players[i].dir, X)), "%lc", charofdir(game.players[i].dir));
-
-    mvwprintw(ui[i], 17, 9, "%03d°", game.players[i].dir * 45);
-
-    if (total_vel(game.players[i].data) > 0.995) {
-      mvwprintw(ui[i], 23, 20, "100.000%%");
-    } 
-    else {
-      mvwprintw(ui[i], 23, 20, "%07.3f%%", total_vel(game.players[i].data) * 100);
-    }
-
-    mvwprintw(ui[i], 24, 20, "%07.3f°", fmod(atan2(game.players[i].data.vely, game.players[i].data.velx) * 180/M_PI + 450, 360));
   }
 
-  if (game.players[0].acc) {
-    mvwaddch(ui1, 12, 4, "^\"*8°"[rand()%5]);
-    mvwaddch(ui1, 12, 8, "^\"*8°"[rand()%5]);
-  }
-  if (game.players[1].acc) {
-    mvwaddch(ui2, 12, 6, "^\"*8°"[rand()%5]);
+  for (int i=0; i < game->n_wells; i++) {
+    int row, col;
+    if (camera_cell(cam, game->wells[i].y, game->wells[i].x, &row, &col)) {
+      view_put(view, row, col, charoftype(BLACKHOLE), 1);
+    }
   }
 
-  wnoutrefresh(ui1);
-  wnoutrefresh(ui2);
+  view_end(view);
 
-  doupdate();
+  hud_update(hud1, game);
+  hud_update(hud2, game);
 }
 
 
 // Draws the title screen/pause menu
-void update_menu_screen(WINDOW *win, GameState game, int selected, int winner) {
-  werase(win);
-
-  mvwprintw(win, 10, (WIN_W-49)/2, " _____                                         _ ");
-  mvwprintw(win, 11, (WIN_W-49)/2, "/  ___|                                       | |");
-  mvwprintw(win, 12, (WIN_W-49)/2, "\\ `--. _ __   __ _  ___ _____      ____ _ _ __| |");
-  mvwprintw(win, 13, (WIN_W-49)/2, " `--. \\ '_ \\ / _` |/ __/ _ \\ \\ /\\ / / _` | '__| |");
-  mvwprintw(win, 14, (WIN_W-49)/2, "/\\__/ / |_) | (_| | (_|  __/\\ V  V / (_| | |  |_|");
-  mvwprintw(win, 15, (WIN_W-49)/2, "\\____/| .__/ \\__,_|\\___\\___| \\_/\\_/ \\__,_|_|  (_)");
-  mvwprintw(win, 16, (WIN_W-49)/2, "      | |                                        ");
-  mvwprintw(win, 17, (WIN_W-49)/2, "      |_|                                        ");
+void update_menu_screen(Surface *win, GameState *game, int selected, int winner) {
+  surf_erase(win);
+
+  surf_print(win, 10, (WIN_W-49)/2, " _____                                         _ ");
+  surf_print(win, 11, (WIN_W-49)/2, "/  ___|                                       | |");
+  surf_print(win, 12, (WIN_W-49)/2, "\\ `--. _ __   __ _  ___ _____      ____ _ _ __| |");
+  surf_print(win, 13, (WIN_W-49)/2, " `--. \\ '_ \\ / _` |/ __/ _ \\ \\ /\\ / / _` | '__| |");
+  surf_print(win, 14, (WIN_W-49)/2, "/\\__/ / |_) | (_| | (_|  __/\\ V  V / (_| | |  |_|");
+  surf_print(win, 15, (WIN_W-49)/2, "\\____/| .__/ \\__,_|\\___\\___| \\_/\\_/ \\__,_|_|  (_)");
+  surf_print(win, 16, (WIN_W-49)/2, "      | |                                        ");
+  surf_print(win, 17, (WIN_W-49)/2, "      |_|                                        ");
 
   if (selected == 0) {
-    mvwprintw(win, 23, (WIN_W-13)/2, " ─┤ PLAY! ├─ ");
-    mvwprintw(win, 26, (WIN_W-13)/2, "─╴  QUIT?  ╶─");
+    surf_print(win, 23, (WIN_W-13)/2, " ─┤ PLAY! ├─ ");
+    surf_print(win, 26, (WIN_W-13)/2, "─╴  QUIT?  ╶─");
   }
   else {
-    mvwprintw(win, 23, (WIN_W-13)/2, "─╴  PLAY?  ╶─");
-    mvwprintw(win, 26, (WIN_W-13)/2, " ─┤ QUIT! ├─ ");
+    surf_print(win, 23, (WIN_W-13)/2, "─╴  PLAY?  ╶─");
+    surf_print(win, 26, (WIN_W-13)/2, " ─┤ QUIT! ├─ ");
   }
 
-  mvwprintw(win, 20, (WIN_W-3)/2-15, "P 1");
-  mvwprintw(win, 20, (WIN_W-3)/2+15, "P 2");
+  surf_print(win, 20, (WIN_W-3)/2-15, "P 1");
+  surf_print(win, 20, (WIN_W-3)/2+15, "P 2");
 
   draw_ship(win, 22, (WIN_W-7)/2-15, 1);
   draw_ship(win, 22, (WIN_W-7)/2+15, 2);
 
-  mvwprintw(win, 29, (WIN_W-7)/2-15, "W A S D");
-  mvwprintw(win, 29, (WIN_W-7)/2+15, "↑ ← ↓ →");
+  surf_print(win, 29, (WIN_W-7)/2-15, "W A S D");
+  surf_print(win, 29, (WIN_W-7)/2+15, "↑ ← ↓ →");
 
   if (winner) {
-    mvwprintw(win, 32, (WIN_W-13)/2, "PLAYER %d WINS", winner);
-    mvwprintw(win, 34, (WIN_W-37)/2, "P1 SCORE  %05d       P2 SCORE  %05d", game.players[0].score, game.players[1].score);
+    surf_print(win, 32, (WIN_W-13)/2, "PLAYER %d WINS", winner);
+    surf_print(win, 34, (WIN_W-37)/2, "P1 SCORE  %05d       P2 SCORE  %05d", game->players[0].score, game->players[1].score);
 
-    mvwaddch(win, 27, (WIN_W-7)/2-10, "^\"*8°"[rand() % 5]);
-    mvwaddch(win, 27, (WIN_W-7)/2-14, "^\"*8°"[rand() % 5]);
-    mvwaddch(win, 27, (WIN_W-7)/2+18, "^\"*8°"[rand() % 5]);
+    surf_put(win, 27, (WIN_W-7)/2-10, L"^\"*8°"[rand() % 5]);
+    surf_put(win, 27, (WIN_W-7)/2-14, L"^\"*8°"[rand() % 5]);
+    surf_put(win, 27, (WIN_W-7)/2+18, L"^\"*8°"[rand() % 5]);
   }
 
-  wrefresh(win);
+  surf_refresh(win);
+  surf_present(win);
 }
 
 
@@ -399,45 +215,126 @@ void handle_menu_inputs(int keys[], int *pause_toggle, int *selected, int *quit)
   }
 }
 
-// Handles the key presses for while the game is running 
-void handle_game_inputs(GameState *game, int keys[], int *pause_toggle) {
-  for (int i = 0; i < 8 && keys[i] != ERR; i++) {
-    if (keys[i] == '\n') {
-      *pause_toggle = true;
-    }
-    else if (keys[i] == 'w' && game->players[0].temp >= 0) {
-      game->players[0].acc = !game->players[0].acc;
-    }
-    else if (keys[i] == 'a') {
-      game->players[0].dir -= 1;
-      if(game->players[0].dir < 0) { game->players[0].dir += 8;}
-    }
-    else if (keys[i] == 'd') {
-      game->players[0].dir += 1;
-      game->players[0].dir %= 8;
-    }
-    else if (keys[i] == 's' && game->bullets[0].type == ERR) {
-      game->bullets[0] = new_bullet(game->players[0].data.y+2*thrust_vector(game->players[0].dir, Y), game->players[0].data.x+2*thrust_vector(game->players[0].dir, X));
-      game->bullets[0].data.vely = game->players[0].data.vely + 0.5*thrust_vector(game->players[0].dir, Y);
-      game->bullets[0].data.velx = game->players[0].data.velx + 0.5*thrust_vector(game->players[0].dir, X);
-    }
-    else if (keys[i] == KEY_UP  && game->players[1].temp >= 0) {
-      game->players[1].acc = !game->players[1].acc;
-    }
-    else if (keys[i] == KEY_LEFT) {
-      game->players[1].dir -= 1;
-      if(game->players[1].dir < 0) { game->players[1].dir += 8;}
+
+
+// Everything on screen, drawn through ncurses or, with --ansi, straight to the terminal
+typedef struct Display {
+  int ansi;
+  Term term;
+  Surface win, ui1, ui2;
+  Surface timings;
+  Hud hud1, hud2;
+} Display;
+
+
+// Creates main game windows and UI windows for HUDs in correct place in centre of screen
+int open_display(Display *display, int ansi) {
+  int scrh;
+  int scrw;
+  Term *term = NULL;
+  display->ansi = ansi;
+
+  // --ansi skips ncurses and drives the terminal directly, with one write() per frame
+  if (ansi) {
+    if (term_open(&display->term, STDOUT_FILENO, STDIN_FILENO) < 0) {
+      fprintf(stderr, "Couldn't set up the terminal\n");
+      return -1;
     }
-    else if (keys[i] == KEY_RIGHT) {
-      game->players[1].dir += 1;
-      game->players[1].dir %= 8;
+    term = &display->term;
+    scrh = term->h;
+    scrw = term->w;
+  }
+  else {
+    setup();
+    getmaxyx(stdscr, scrh, scrw);
+  }
+
+  display->win = new_surface(term, WIN_H, WIN_W, (scrh-WIN_H)/2, (scrw-WIN_W)/2);
+  display->ui1 = new_surface(term, UI_SIZE-2, UI_SIZE, (scrh-WIN_H)/2, (scrw-UI_SIZE)/2-69);
+  display->ui2 = new_surface(term, UI_SIZE-2, UI_SIZE, (scrh-WIN_H)/2, (scrw-UI_SIZE)/2+69);
+  display->timings = new_surface(term, WIN_H-UI_SIZE+2, UI_SIZE, (scrh-WIN_H)/2+UI_SIZE-2, (scrw-UI_SIZE)/2-69);
+  surf_colour(&display->win, 1);
+  surf_colour(&display->ui1, 1);
+  surf_colour(&display->ui2, 1);
+  surf_colour(&display->timings, 1);
+  hud_init(&display->hud1, &display->ui1, 1);
+  hud_init(&display->hud2, &display->ui2, 2);
+  return 0;
+}
+
+void close_display(Display *display) {
+  if (display->ansi) {
+    term_close(&display->term);
+  }
+  else {
+    endwin();
+  }
+}
+
+// Reads up to 7 waiting key presses into keys[], ERR terminated
+void read_keys(Display *display, int keys[]) {
+  int ch;
+  int ch_num = 0;
+  if (display->ansi) {
+    ch_num = term_read_keys(&display->term, keys, 7);
+  }
+  while (!display->ansi && ch_num < 7 && (ch = getch()) != ERR) {
+    keys[ch_num] = ch;
+    ch_num++;
+  }
+  keys[ch_num] = ERR;
+}
+
+
+/* WATCH MAIN
+ * Shows a match being played by another process started with --spectate, with the same arena and HUDs
+ * Nothing is simulated here, every frame comes from the stream. Enter quits, as does the game ending
+ */
+
+int watch_main(const char *path, int ansi, int camera) {
+  SpecClient client;
+  if (spec_connect(&client, path) < 0) {
+    return 1;
+  }
+
+  Display display;
+  if (open_display(&display, ansi) < 0) {
+    spec_disconnect(&client);
+    return 1;
+  }
+  create_ui(&display.hud1);
+  create_ui(&display.hud2);
+
+  ArenaView view;
+  view_init(&view, &display.win, WIN_H, WIN_W);
+  Camera cam = (Camera){ .mode = camera };
+
+  static GameState game;
+  new_game(&game, 2);
+
+  int quit = false;
+  while (!quit) {
+    struct pollfd fds[2] = {{client.fd, POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+    poll(fds, 2, -1);
+
+    int keys_pressed[8];
+    read_keys(&display, keys_pressed);
+    for (int i = 0; keys_pressed[i] != ERR; i++) {
+      if (keys_pressed[i] == '\n') { quit = true; }
     }
-    else if (keys[i] == KEY_DOWN && game->bullets[1].type == ERR) {
-      game->bullets[1] = new_bullet(game->players[1].data.y+2*thrust_vector(game->players[1].dir, Y), game->players[1].data.x+2*thrust_vector(game->players[1].dir, X));
-      game->bullets[1].data.vely = game->players[1].data.vely + 0.5*thrust_vector(game->players[1].dir, Y);
-      game->bullets[1].data.velx = game->players[1].data.velx + 0.5*thrust_vector(game->players[1].dir, X);
+
+    int status = spec_receive(&client, &game);
+    if (status < 0) { quit = true; }
+    if (status > 0) {
+      update_screen(&view, &cam, &display.hud1, &display.hud2, &game);
+      surf_present(&display.win);
     }
   }
+
+  close_display(&display);
+  view_free(&view);
+  spec_disconnect(&client);
+  return 0;
 }
 
 
@@ -446,110 +343,370 @@ void handle_game_inputs(GameState *game, int keys[], int *pause_toggle) {
  * Runs game loop
  */
 
-int main() {
-  setup();
+int main(int argc, char *argv[]) {
+  // Headless mode skips ncurses entirely and runs a scripted match as fast as possible
+  if (argc >= 2 && strcmp(argv[1], "--headless") == 0) {
+    return headless_main(argc-2, argv+2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--batch") == 0) {
+    return batch_main(argc-2, argv+2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--replay") == 0) {
+    return replay_main(argc-2, argv+2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--cast") == 0) {
+    return cast_main(argc-2, argv+2, (CastScreen){ create_ui, update_screen });
+  }
+  if (argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+    return bench_main(argc-2, argv+2, update_screen);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--check-blend") == 0) {
+    return check_blend_main(argc-2, argv+2);
+  }
+  if (argc >= 2 && strcmp(argv[1], "--check-kernels") == 0) {
+    return check_kernels_main(argc-2, argv+2);
+  }
+
+  int show_stats = false;
+  int ansi = false;
+  const char *record = NULL;
+  const char *save = NULL;
+  const char *spectate = NULL;
+  const char *watch = NULL;
+  int profile = false;
+  const char *trace = NULL;
+  int fixed_point = false;
+  int torpedoes = SHIP_TORPEDOES;
+  int fps = FRAMERATE;
+  int use_bot = false;
+  int arena_h = ARENA_H, arena_w = ARENA_W;
+  int camera = CAM_BOTH;
+  int bot_threads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+  int bot_ms = BOT_BUDGET_MS;
+  NetConfig net_config = { 0, 7000, NULL, 0, 10, 0 };
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--frame-stats") == 0) { show_stats = true; }
+    else if (strcmp(argv[i], "--ansi") == 0) { ansi = true; }
+    else if (strcmp(argv[i], "--record") == 0 && i+1 < argc) { record = argv[++i]; }
+    else if (strcmp(argv[i], "--save") == 0 && i+1 < argc) { save = argv[++i]; }
+    else if (strcmp(argv[i], "--spectate") == 0 && i+1 < argc) { spectate = argv[++i]; }
+    else if (strcmp(argv[i], "--watch") == 0 && i+1 < argc) { watch = argv[++i]; }
+    else if (strcmp(argv[i], "--profile") == 0) { profile = true; }
+    else if (strcmp(argv[i], "--trace") == 0 && i+1 < argc) { trace = argv[++i]; }
+    else if (strcmp(argv[i], "--fixed") == 0) { fixed_point = true; }
+    else if (strcmp(argv[i], "--torpedoes") == 0 && i+1 < argc) { torpedoes = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--fps") == 0 && i+1 < argc) { fps = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--bot") == 0) { use_bot = true; }
+    else if (strcmp(argv[i], "--world") == 0 && i+1 < argc) {
+      if (!parse_world(argv[++i], &arena_h, &arena_w)) { return 1; }
+    }
+    else if (strcmp(argv[i], "--camera") == 0 && i+1 < argc) {
+      i++;
+      camera = strcmp(argv[i], "1") == 0 ? CAM_P1 : strcmp(argv[i], "2") == 0 ? CAM_P2 : CAM_BOTH;
+    }
+    else if (strcmp(argv[i], "--bot-threads") == 0 && i+1 < argc) { bot_threads = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--bot-ms") == 0 && i+1 < argc) { bot_ms = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--net") == 0 && i+1 < argc) { net_config.player = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--port") == 0 && i+1 < argc) { net_config.port = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--peer") == 0 && i+1 < argc) { net_config.peer = argv[++i]; }
+    else if (strcmp(argv[i], "--input-delay") == 0 && i+1 < argc) { net_config.delay = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--rollback") == 0 && i+1 < argc) { net_config.window = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--latency") == 0 && i+1 < argc) { net_config.latency = atoi(argv[++i]); }
+  }
 
-  // Create main game windows and UI windows for HUDs in correct place in centre of screen
-  int scrh;
-  int scrw;
-  getmaxyx(stdscr, scrh, scrw);
+  if (torpedoes < 1 || torpedoes > MAX_BULLETS) {
+    fprintf(stderr, "--torpedoes must be between 1 and %d\n", MAX_BULLETS);
+    return 1;
+  }
+  // 0 draws as often as the terminal will take it, which the busy terminal check below turns into a real limit
+  if (fps < 0 || fps > 1000) {
+    fprintf(stderr, "--fps must be between 0 and 1000\n");
+    return 1;
+  }
+  if (fps == 0) { fps = 1000; }
+
+  // --net plays one side of a match against another process, which owns the other ship
+  Net net;
+  int netplay = net_config.player != 0;
+  if (netplay && net_config.player != 1 && net_config.player != 2) {
+    fprintf(stderr, "--net must be 1 or 2\n");
+    return 1;
+  }
+  if (netplay && use_bot) {
+    fprintf(stderr, "--bot plays player 2 on this machine, it can't be used with --net\n");
+    return 1;
+  }
+  if (netplay && save) {
+    fprintf(stderr, "--save keeps a match on this machine, it can't be used with --net\n");
+    return 1;
+  }
+  if (netplay && net_open(&net, &net_config) < 0) {
+    return 1;
+  }
 
-  WINDOW *win = newwin(WIN_H, WIN_W, (scrh-WIN_H)/2, (scrw-WIN_W)/2);
-  WINDOW *ui1 = newwin(UI_SIZE-2, UI_SIZE, (scrh-WIN_H)/2, (scrw-UI_SIZE)/2-69);
-  WINDOW *ui2 = newwin(UI_SIZE-2, UI_SIZE, (scrh-WIN_H)/2, (scrw-UI_SIZE)/2+69);
-  wcolour(win, 1);
-  wcolour(ui1, 1);
-  wcolour(ui2, 1);
+  if (watch) {
+    return watch_main(watch, ansi, camera);
+  }
 
   // Initiate array of all game objects (the black hole, the players, and empty spots for torpedoes to spawn);
   GameState game;
-  game.bh = (BlackHole){WIN_H+0.5, (double)WIN_W/2};
-  game.players[0] = new_player(PLAYER1, P1_Y, P1_X, NW, 0);
-  game.players[1] = new_player(PLAYER2, P2_Y, P2_X, SE, 0);
-  game.bullets[0] = err_bullet();
-  game.bullets[1] = err_bullet();
-
-  // Start timing to calculate frametimes
-  int frame = 0;
-  int delta = 0;
-  struct timespec start;
-  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+  new_game(&game, 2);
+  if (arena_h != ARENA_H || arena_w != ARENA_W) { resize_arena(&game, arena_h, arena_w); }
+  if (fixed_point) { use_fixed_point(&game); }
+  game.torpedo_limit = torpedoes;
+
+  // With --save the match carries on from where it was last saved, and is saved every few seconds and on quitting
+  Checkpoint ckpt;
+  if (save && ((access(save, F_OK) == 0 && ckpt_load(save, &game) < 0) || ckpt_open(&ckpt, save) < 0)) {
+    return 1;
+  }
+
+  // Set up spectating before the screen, so an error can still be seen
+  SpecServer spec;
+  if (spectate && spec_listen(&spec, spectate) < 0) {
+    return 1;
+  }
+
+  Display display;
+  if (open_display(&display, ansi) < 0) {
+    return 1;
+  }
+  Surface *win = &display.win;
+  Surface *ui1 = &display.ui1;
+  Surface *ui2 = &display.ui2;
+
+  // Keys are read and timestamped on their own thread, so none are lost and each lands on the tick it was pressed in
+  InputThread input;
+  if (input_start(&input, STDIN_FILENO) < 0) {
+    close_display(&display);
+    return 1;
+  }
+
+  // With --bot the computer flies player 2, thinking on its own threads (leaving a core for the game when there is one)
+  Bot bot;
+  if (use_bot && bot_start(&bot, 1, bot_threads > 0 ? bot_threads : 1, bot_ms) < 0) {
+    input_stop(&input);
+    close_display(&display);
+    return 1;
+  }
+
+  // Phase timings are off unless asked for, the ` key shows them (and turns them on) while playing
+  prof_init(profile, trace != NULL);
+  int show_timings = false;
+
+  // The newest frame from the simulation, and the blend of its two states that actually gets drawn
+  static GameState shown;
+  long dropped = 0;
+
+  ArenaView view;
+  view_init(&view, win, WIN_H, WIN_W);
+  Camera cam = (Camera){ .mode = camera };
+
+  // The screen has its own scheduler at --fps, physics ticks at TICK_RATE on the simulation thread whatever this does
+  Scheduler sched;
+  sched_init(&sched, 1000000000/fps);
+
+  // Everything the tick loop needs is set once here, the simulation owns it whenever it is running
+  static Sim sim;
+  if (sim_init(&sim) < 0) {
+    if (use_bot) { bot_stop(&bot); }
+    input_stop(&input);
+    close_display(&display);
+    return 1;
+  }
+  sim.game = &game;
+  sim.input = &input;
+  sim.net = netplay ? &net : NULL;
+  sim.bot = use_bot ? &bot : NULL;
+  sim.ckpt = save ? &ckpt : NULL;
+  sim.spec = spectate ? &spec : NULL;
+  int timing_presses = 0, camera_presses = 0;
 
   int quit = false;
+  // A network match goes straight into the game, it waits there for the peer
   int paused = true;
-  int pause_toggle = false;
+  int pause_toggle = netplay;
   int selected = 0;
   int winner = 0;
 
-  while (!quit) { 
-    if (delta >= 1000000000/FRAMERATE) {
-      clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+  // What the menu last showed, so it is only redrawn when something on it changes
+  int menu_selected = -1;
+  int menu_winner = -1;
+
+  // With --record every match goes to its own replay file, PREFIX-1.swr, PREFIX-2.swr and so on
+  Recorder rec;
+  int recording = false;
+  int match = 0;
+
+  while (!quit) {
+    /* While paused nothing moves, so only wake up for key presses (unless the menu has just been left, or not drawn yet)
+     * While playing, wake up for each frame or for the simulation stopping
+     */
+    long long t = prof_begin();
+    int frame_due = paused
+      ? sched_wait(&sched, input.wake, pause_toggle || menu_selected < 0 || netplay)
+      : sched_wait(&sched, sim.wake, true);
+    prof_end(PH_WAIT, t);
+
+    long long frame_start = t = prof_begin();
+    // The simulation stops itself when the match is paused or won or the peer is gone, the game is this thread's again
+    if (!paused && !sim.running) {
+      sim_stop(&sim);
+      pause_toggle = true;
+      winner = sim.winner;
+      if (sim.lost) { quit = true; }
+      if (recording && winner) {
+        rec_close(&rec, &game);
+        recording = false;
+      }
+    }
 
-      int keys_pressed[8] = {-1,-1,-1,-1,-1,-1,-1,-1};
-      int ch;
-      int ch_num = 0;
-      while ((ch = getch()) != ERR) {
-        keys_pressed[ch_num] = ch;
-        ch_num++;
+    // Only while the simulation isn't running, otherwise it does this itself
+    if (paused) {
+      input_ack(&input);
+      if (spectate) {
+        spec_poll(&spec);
       }
-      keys_pressed[ch_num] = ERR;
-
-      if (pause_toggle && paused) {
-        create_ui(ui1, 1);
-        create_ui(ui2, 2);
-
-        if (winner) {
-          destroy(&game.players[0]);
-          destroy(&game.players[1]);
-          game.bullets[0] = err_bullet();
-          game.bullets[1] = err_bullet();
-          game.players[0].score = 0;
-          game.players[1].score = 0;
-        }
+      if (netplay) {
+        net_poll(&net, &game);
+        if (net.lost) { quit = true; }
+      }
+      prof_end(PH_INPUT, t);
+    }
+
+    if (pause_toggle && paused && !quit) {
+      create_ui(&display.hud1);
+      create_ui(&display.hud2);
+      view_invalidate(&view);
 
-        paused = false;
-        pause_toggle = false;
+      // Clear the winner once the match is reset, so pausing the next one doesn't reset it again
+      if (winner) {
+        reset_match(&game);
+        winner = 0;
       }
-      else if (pause_toggle && !paused) {
-        werase(ui1);
-        werase(ui2);
-        wnoutrefresh(ui1);
-        wnoutrefresh(ui2);
-        doupdate();
-        paused = true;
-        pause_toggle = false;
+
+      if (record && !recording && !netplay) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof path, "%s-%d.swr", record, ++match);
+        recording = rec_open(&rec, path, &game, SNAPSHOT_INTERVAL) == 0;
       }
+      sim.rec = recording ? &rec : NULL;
+      sim_start(&sim);
 
-      if (paused) {
+      paused = false;
+      pause_toggle = false;
+    }
+    else if (pause_toggle && !paused) {
+      surf_erase(ui1);
+      surf_erase(ui2);
+      surf_refresh(ui1);
+      surf_refresh(ui2);
+      surf_present(ui1);
+      paused = true;
+      pause_toggle = false;
+      menu_selected = -1;
+    }
+
+    if (paused) {
+      // One key at a time, so whatever comes after the key that starts the game is left for the game
+      int keys_pressed[8];
+      while (!pause_toggle && !quit && input_take(&input, LLONG_MAX, keys_pressed, 1)) {
         handle_menu_inputs(keys_pressed, &pause_toggle, &selected, &quit);
-        update_menu_screen(win, game, selected, winner);
       }
-      else {
-        handle_game_inputs(&game, keys_pressed, &pause_toggle);
-        update_physics(&game, delta, frame);
-        update_screen(win, ui1, ui2, game);
 
-        if (game.players[0].score >= 1000 || game.players[1].score <= -1000) {
-          pause_toggle = true;
-          winner = 1;
-        }
-        else if (game.players[1].score >= 1000 || game.players[0].score <= -1000) {
-          pause_toggle = true;
-          winner = 2;
+      // There is no rematch over the network, a finished match just ends
+      if (netplay && winner && pause_toggle) { quit = true; }
+      if (selected != menu_selected || winner != menu_winner) {
+        update_menu_screen(win, &game, selected, winner);
+        menu_selected = selected;
+        menu_winner = winner;
+      }
+    }
+    else if (frame_due) {
+      // The keys that change the screen rather than the game were counted by the simulation as it took them
+      for (; camera_presses < sim.camera_presses; camera_presses++) {
+        cam.mode = (cam.mode + 1) % CAM_MODES;
+      }
+      for (; timing_presses < sim.timing_presses; timing_presses++) {
+        show_timings = !show_timings;
+        prof.enabled = prof.enabled || show_timings;
+        if (!show_timings) {
+          surf_erase(&display.timings);
+          surf_refresh(&display.timings);
         }
       }
 
-      delta = 0;
-      frame++;
-    }
-    else {
-      struct timespec end;
-      clock_gettime(CLOCK_MONOTONIC_RAW, &end);
-      delta = get_delta(&start, &end);
+      /* A terminal that can't take any more output is behind, so this frame is dropped rather than queued up
+       * Physics is on its own thread, so the game keeps its speed and the next frame drawn is simply further along
+       * The newest frame is drawn however far it has got between its two ticks, up to all the way if the next is late
+       */
+      struct pollfd out = {STDOUT_FILENO, POLLOUT, 0};
+      if (poll(&out, 1, 0) == 1 && (out.revents & POLLOUT)) {
+        t = prof_begin();
+        const Frame *frame = sim_frame(&sim);
+        blend_states(&shown, &frame->prev, &frame->cur, frame_alpha(frame, now_ns()));
+        update_screen(&view, &cam, &display.hud1, &display.hud2, &shown);
+        if (show_timings) { prof_overlay(&display.timings); }
+        prof_end(PH_DRAW, t);
+
+        t = prof_begin();
+        surf_present(win);
+        prof_end(PH_PRESENT, t);
+      }
+      else {
+        dropped++;
+      }
+      prof_end(PH_FRAME, frame_start);
     }
-  
   }
 
-  endwin();
+  // Quitting from the menu is the only way out, except losing the peer, but stop it if it is somehow still going
+  if (sim.running) {
+    sim_stop(&sim);
+  }
+
+  if (recording) {
+    rec_close(&rec, &game);
+  }
+
+  // A finished match is saved as the rematch it would have become
+  if (save) {
+    if (winner) { reset_match(&game); }
+    ckpt_save(&ckpt, &game);
+    ckpt_close(&ckpt);
+  }
+
+  if (use_bot) {
+    if (show_stats) { bot_report(&bot, stderr); }
+    bot_stop(&bot);
+  }
+  input_stop(&input);
+  close_display(&display);
+  view_free(&view);
+  sched_close(&sched);
+  sim_close(&sim);
+  if (show_stats) {
+    fprintf(stderr, "screen: ");
+    sched_report(&sched, stderr);
+    fprintf(stderr, "physics: ");
+    sched_report(&sim.sched, stderr);
+    fprintf(stderr, "%ld frames dropped while the terminal was busy\n", dropped);
+  }
+  if (profile) {
+    prof_report(stderr);
+  }
+  if (trace && prof_write_trace(trace) == 0) {
+    fprintf(stderr, "Wrote %ld trace events to %s\n", prof_trace_events(), trace);
+  }
+  prof_free();
+  if (spectate) {
+    if (show_stats) { spec_report(&spec, stderr); }
+    spec_close(&spec);
+  }
+  if (netplay) {
+    if (net.lost) { fprintf(stderr, "Lost contact with the other player\n"); }
+    if (show_stats) { net_report(&net, stderr); }
+    net_close(&net);
+  }
   return 0;
 }
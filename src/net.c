@@ -0,0 +1,287 @@
+#include "net.h"
+#include "serial.h"
+#include "sched.h"
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+#define NET_MAGIC_0 'S'
+#define NET_MAGIC_1 'W'
+#define HELLO_NS 100000000LL
+#define TIMEOUT_NS 5000000000LL
+
+enum Packet { HELLO, INPUTS };
+
+
+static void send_packet(Net *net, const unsigned char *bytes, int len) {
+  if (net->latency <= 0) {
+    sendto(net->sock, bytes, len, 0, (struct sockaddr *)&net->peer, sizeof net->peer);
+    return;
+  }
+
+  // Every packet is held back by the same amount, so the queue stays in send order
+  if (net->n_queued == NET_QUEUE) {
+    return;
+  }
+  Delayed *d = &net->queue[net->n_queued++];
+  d->at = now_ns() + net->latency * 1000000LL;
+  d->len = len;
+  memcpy(d->bytes, bytes, len);
+}
+
+static void flush_queue(Net *net) {
+  long long now = now_ns();
+  int sent = 0;
+  while (sent < net->n_queued && net->queue[sent].at <= now) {
+    Delayed *d = &net->queue[sent++];
+    sendto(net->sock, d->bytes, d->len, 0, (struct sockaddr *)&net->peer, sizeof net->peer);
+  }
+  memmove(net->queue, net->queue + sent, (net->n_queued - sent) * sizeof(Delayed));
+  net->n_queued -= sent;
+}
+
+static void send_hello(Net *net) {
+  unsigned char bytes[32] = { NET_MAGIC_0, NET_MAGIC_1, HELLO };
+  int len = 3;
+  len += put_varint(bytes+len, net->local+1);
+  len += put_varint(bytes+len, net->delay);
+  send_packet(net, bytes, len);
+  net->last_hello = now_ns();
+}
+
+// Sends every local input the peer hasn't acknowledged, along with which remote tick this side needs next
+static void send_inputs(Net *net) {
+  long first = net->peer_needs;
+  if (first < net->local_newest - NET_HISTORY + 1) { first = net->local_newest - NET_HISTORY + 1; }
+  long count = net->local_newest - first + 1;
+  if (count < 0) { count = 0; }
+
+  unsigned char bytes[512] = { NET_MAGIC_0, NET_MAGIC_1, INPUTS };
+  int len = 3;
+  len += put_varint(bytes+len, net->remote_confirmed + 1);
+  len += put_varint(bytes+len, first);
+  len += put_varint(bytes+len, count);
+  for (long k = first; k < first + count; k++) {
+    len += put_varint(bytes+len, net->local_inputs[k % NET_HISTORY]);
+  }
+  send_packet(net, bytes, len);
+}
+
+
+/* NET OPEN
+ * Binds the local port and looks up the peer, given as HOST:PORT
+ * Nothing is sent until the first net_poll(), returns -1 and says why if the socket or address is no good
+ */
+
+int net_open(Net *net, const NetConfig *config) {
+  memset(net, 0, sizeof *net);
+  net->local = config->player - 1;
+  net->remote = 1 - net->local;
+  net->delay = config->delay < 0 ? 0 : config->delay > MAX_INPUT_DELAY ? MAX_INPUT_DELAY : config->delay;
+  net->window = config->window < 1 ? 1 : config->window > MAX_ROLLBACK ? MAX_ROLLBACK : config->window;
+  net->latency = config->latency;
+  net->local_newest = net->delay - 1;
+  net->remote_confirmed = -1;
+  net->rollback_from = -1;
+
+  char host[256];
+  const char *colon = config->peer ? strrchr(config->peer, ':') : NULL;
+  if (!colon || colon == config->peer || colon - config->peer >= (long)sizeof host) {
+    fprintf(stderr, "--peer must be HOST:PORT\n");
+    return -1;
+  }
+  memcpy(host, config->peer, colon - config->peer);
+  host[colon - config->peer] = '\0';
+
+  struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_DGRAM };
+  struct addrinfo *found;
+  int status = getaddrinfo(host, colon+1, &hints, &found);
+  if (status != 0) {
+    fprintf(stderr, "%s: %s\n", config->peer, gai_strerror(status));
+    return -1;
+  }
+  memcpy(&net->peer, found->ai_addr, sizeof net->peer);
+  freeaddrinfo(found);
+
+  net->sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  struct sockaddr_in local = { .sin_family = AF_INET, .sin_port = htons(config->port), .sin_addr.s_addr = htonl(INADDR_ANY) };
+  if (net->sock < 0 || bind(net->sock, (struct sockaddr *)&local, sizeof local) < 0) {
+    perror("udp socket");
+    if (net->sock >= 0) { close(net->sock); }
+    return -1;
+  }
+
+  net->n_saved = net->window + 2;
+  net->saved = malloc(net->n_saved * sizeof(GameState));
+  return 0;
+}
+
+void net_close(Net *net) {
+  close(net->sock);
+  free(net->saved);
+  net->saved = NULL;
+}
+
+// Turns this frame's key presses into the local player's next input, either set of controls works
+void net_keys(Net *net, int keys[]) {
+  for (int i = 0; i < 8 && keys[i] != ERR; i++) {
+    enum Action action;
+    if (key_action(keys[i], &action) >= 0) {
+      net->pending = input_add(net->pending, action);
+    }
+  }
+}
+
+
+// Reads one INPUTS packet, any input that differs from what the game assumed marks where to roll back to
+static void read_inputs(Net *net, const GameState *game, Reader *in) {
+  long needs = get_varint(in);
+  long first = get_varint(in);
+  long count = get_varint(in);
+  if (in->bad) {
+    return;
+  }
+  if (needs > net->peer_needs) { net->peer_needs = needs; }
+
+  for (long k = first; k < first + count; k++) {
+    Input input = get_varint(in);
+    if (in->bad || k != net->remote_confirmed + 1) {
+      continue;
+    }
+
+    net->remote_inputs[k % NET_HISTORY] = input;
+    net->remote_confirmed = k;
+    if (k < game->tick && net->predicted[k % NET_HISTORY] != input && (net->rollback_from < 0 || k < net->rollback_from)) {
+      net->rollback_from = k;
+    }
+  }
+}
+
+
+/* NET POLL
+ * Sends anything the fake latency was holding back, says hello until the peer answers, and reads every packet
+ * waiting. Call it every frame, even when the game can't advance, so acknowledgements keep flowing
+ */
+
+void net_poll(Net *net, const GameState *game) {
+  long long now = now_ns();
+  flush_queue(net);
+
+  if (!net->connected && now - net->last_hello > HELLO_NS) {
+    send_hello(net);
+  }
+
+  unsigned char bytes[1024];
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof from;
+  ssize_t len;
+  while ((len = recvfrom(net->sock, bytes, sizeof bytes, 0, (struct sockaddr *)&from, &from_len)) > 0) {
+    from_len = sizeof from;
+    if (len < 3 || bytes[0] != NET_MAGIC_0 || bytes[1] != NET_MAGIC_1
+        || from.sin_addr.s_addr != net->peer.sin_addr.s_addr || from.sin_port != net->peer.sin_port) {
+      continue;
+    }
+
+    Reader in = { bytes+3, bytes+len, false };
+    if (bytes[2] == HELLO) {
+      int player = get_varint(&in);
+      int delay = get_varint(&in);
+      if (in.bad || player-1 != net->remote || delay > MAX_INPUT_DELAY) {
+        continue;
+      }
+      // The peer's first delay ticks have no inputs, so they are known before anything arrives
+      if (!net->connected) {
+        net->connected = true;
+        net->remote_confirmed = delay - 1;
+      }
+      send_hello(net);
+    }
+    else if (bytes[2] == INPUTS && net->connected) {
+      read_inputs(net, game, &in);
+    }
+    net->last_heard = now;
+  }
+
+  if (net->connected) {
+    if (now - net->last_heard > TIMEOUT_NS) { net->lost = true; }
+    send_inputs(net);
+  }
+}
+
+
+// Plays one tick with the inputs known so far, saving the state first in case it has to be played again
+static void simulate(Net *net, GameState *game) {
+  long k = game->tick;
+  copy_state(&net->saved[k % net->n_saved], game);
+
+  Input inputs[2];
+  inputs[net->local] = net->local_inputs[k % NET_HISTORY];
+  inputs[net->remote] = k <= net->remote_confirmed ? net->remote_inputs[k % NET_HISTORY] : 0;
+  net->predicted[k % NET_HISTORY] = inputs[net->remote];
+
+  apply_input(game, 0, inputs[0]);
+  apply_input(game, 1, inputs[1]);
+  update_physics(game, 1);
+}
+
+
+// Replays from the earliest tick a late remote input contradicted, if there is one, back up to where the game was
+void net_rollback(Net *net, GameState *game) {
+  if (net->rollback_from < 0) {
+    return;
+  }
+
+  long tick = game->tick;
+  long depth = tick - net->rollback_from;
+  copy_state(game, &net->saved[net->rollback_from % net->n_saved]);
+  while (game->tick < tick) {
+    simulate(net, game);
+  }
+  net->rollbacks++;
+  net->resimulated += depth;
+  if (depth > net->max_rollback) { net->max_rollback = depth; }
+  net->rollback_from = -1;
+}
+
+
+/* NET ADVANCE
+ * Steps the game one tick, first rolling back and replaying if late remote inputs contradicted a prediction
+ * Returns false without doing anything if the peer hasn't connected, or its inputs are more than window ticks behind
+ */
+
+int net_advance(Net *net, GameState *game) {
+  if (!net->connected || net->lost) {
+    return false;
+  }
+  long tick = game->tick;
+  if (tick - net->remote_confirmed > net->window) {
+    net->stalls++;
+    return false;
+  }
+
+  net_rollback(net, game);
+
+  net->local_newest = tick + net->delay;
+  net->local_inputs[net->local_newest % NET_HISTORY] = net->pending;
+  net->pending = 0;
+  send_inputs(net);
+
+  simulate(net, game);
+  return true;
+}
+
+
+// The latest state that no longer depends on any prediction, which is what decides who wins
+const GameState *net_confirmed_state(Net *net, const GameState *game) {
+  long k = net->remote_confirmed + 1;
+  if (net->rollback_from >= 0 && net->rollback_from < k) { k = net->rollback_from; }
+  if (k >= game->tick) {
+    return game;
+  }
+  return &net->saved[k % net->n_saved];
+}
+
+void net_report(Net *net, FILE *out) {
+  fprintf(out, "rollbacks %ld, %.2f ticks deep on average, %ld at most, stalls %ld\n", net->rollbacks,
+          net->rollbacks ? (double)net->resimulated / net->rollbacks : 0.0, net->max_rollback, net->stalls);
+}
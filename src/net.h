@@ -0,0 +1,67 @@
+#include "game.h"
+#include <netinet/in.h>
+
+#ifndef NET_H
+#define NET_H
+
+// Ticks of inputs kept on each side, more than the furthest either peer can run ahead of the other
+#define NET_HISTORY 128
+#define MAX_INPUT_DELAY 10
+#define MAX_ROLLBACK 50
+#define NET_QUEUE 256
+
+typedef struct NetConfig {
+  int player;
+  int port;
+  const char *peer;
+  int delay, window;
+  int latency;
+} NetConfig;
+
+// A packet held back to fake network latency, sent once the clock reaches at
+typedef struct Delayed {
+  long long at;
+  int len;
+  unsigned char bytes[512];
+} Delayed;
+
+/* A two player match over UDP with rollback
+ * Local inputs are scheduled delay ticks ahead and sent every tick with everything the peer hasn't acknowledged yet
+ * The remote player is predicted to do nothing until their inputs arrive, and when one turns out to be wrong
+ * the game goes back to the state saved before that tick and is simulated forward again with the real inputs
+ * The game never runs more than window ticks past the last remote input it has, states are saved for that far back
+ */
+typedef struct Net {
+  int sock;
+  struct sockaddr_in peer;
+  int local, remote;
+  int delay, window, latency;
+  int connected, lost;
+  long long last_hello, last_heard;
+
+  Input pending;
+  Input local_inputs[NET_HISTORY];
+  Input remote_inputs[NET_HISTORY];
+  Input predicted[NET_HISTORY];
+  long local_newest, remote_confirmed, peer_needs;
+  long rollback_from;
+
+  GameState *saved;
+  int n_saved;
+
+  Delayed queue[NET_QUEUE];
+  int n_queued;
+
+  long rollbacks, resimulated, max_rollback, stalls;
+} Net;
+
+int net_open(Net *net, const NetConfig *config);
+void net_close(Net *net);
+void net_keys(Net *net, int keys[]);
+void net_poll(Net *net, const GameState *game);
+void net_rollback(Net *net, GameState *game);
+int net_advance(Net *net, GameState *game);
+const GameState *net_confirmed_state(Net *net, const GameState *game);
+void net_report(Net *net, FILE *out);
+
+#endif
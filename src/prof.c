@@ -0,0 +1,131 @@
+#include "prof.h"
+
+Profiler prof;
+_Thread_local int prof_lane;
+
+static const char *phase_names[N_PHASES] = { "wait", "input", "keys", "physics", "draw", "present", "spectate", "frame" };
+
+
+void prof_init(int enabled, int tracing) {
+  memset(&prof, 0, sizeof prof);
+  prof.enabled = enabled || tracing;
+  prof.tracing = tracing;
+  prof.origin = now_ns();
+  if (tracing) {
+    prof.events = malloc(MAX_TRACE_EVENTS * sizeof(TraceEvent));
+  }
+}
+
+static int bucket_of(long long ns) {
+  if (ns < PROF_SUBBUCKETS) {
+    return 0;
+  }
+  int b = 63 - __builtin_clzll(ns);
+  int s = (ns >> (b - 2)) & 3;
+  int bucket = PROF_SUBBUCKETS*b + s;
+  return bucket < PROF_BUCKETS ? bucket : PROF_BUCKETS-1;
+}
+
+// The top of a bucket's range, which is what percentiles report
+static long long bucket_top(int bucket) {
+  int b = bucket / PROF_SUBBUCKETS;
+  int s = bucket % PROF_SUBBUCKETS;
+  return (1LL << b) * (PROF_SUBBUCKETS + s + 1) / PROF_SUBBUCKETS;
+}
+
+void prof_record(enum Phase phase, long long start, long long end) {
+  PhaseStats *stats = &prof.phases[phase];
+  long long ns = end - start;
+  stats->count++;
+  stats->total += ns;
+  if (ns > stats->max) { stats->max = ns; }
+  stats->hist[bucket_of(ns)]++;
+
+  if (prof.tracing) {
+    long i = atomic_fetch_add_explicit(&prof.n_events, 1, memory_order_relaxed);
+    if (i < MAX_TRACE_EVENTS) { prof.events[i] = (TraceEvent){phase, prof_lane, start, end}; }
+  }
+}
+
+// Upper bound of the q quantile (0 to 1), to within a quarter of a power of two, the max is exact
+long long prof_percentile(const PhaseStats *stats, double q) {
+  long target = ceil(q * stats->count);
+  long seen = 0;
+  for (int i = 0; i < PROF_BUCKETS; i++) {
+    seen += stats->hist[i];
+    if (seen >= target && seen > 0) {
+      long long top = bucket_top(i);
+      return top < stats->max ? top : stats->max;
+    }
+  }
+  return stats->max;
+}
+
+
+// Whole microseconds, capped to fit a 5 wide column
+static long long column_us(long long ns) {
+  return ns / 1000 > 99999 ? 99999 : ns / 1000;
+}
+
+// Draws a table of every phase's p50, p99 and max in microseconds into a surface at least 30 wide
+void prof_overlay(Surface *surf) {
+  surf_print(surf, 0, 0, "┌───────┤ TIMINGS µs ├───────┐");
+  surf_print(surf, 1, 0, "│ phase      p50   p99   max │");
+  int row = 2;
+  for (int p = 0; p < N_PHASES && row < surf->h-1; p++, row++) {
+    const PhaseStats *stats = &prof.phases[p];
+    surf_print(surf, row, 0, "│ %-8s %5lld %5lld %5lld │", phase_names[p],
+               column_us(prof_percentile(stats, 0.5)), column_us(prof_percentile(stats, 0.99)), column_us(stats->max));
+  }
+  surf_print(surf, row, 0, "└────────────────────────────┘");
+  surf_refresh(surf);
+}
+
+void prof_report(FILE *out) {
+  fprintf(out, "%-12s %8s %10s %10s %10s %10s\n", "phase", "count", "mean us", "p50 us", "p99 us", "max us");
+  for (int p = 0; p < N_PHASES; p++) {
+    const PhaseStats *stats = &prof.phases[p];
+    if (!stats->count) { continue; }
+    fprintf(out, "%-12s %8ld %10.1f %10.1f %10.1f %10.1f\n", phase_names[p], stats->count, stats->total / 1000.0 / stats->count,
+            prof_percentile(stats, 0.5) / 1000.0, prof_percentile(stats, 0.99) / 1000.0, stats->max / 1000.0);
+  }
+}
+
+
+// How many trace events were kept, any past MAX_TRACE_EVENTS were counted but dropped
+long prof_trace_events() {
+  long n = prof.n_events;
+  return n < MAX_TRACE_EVENTS ? n : MAX_TRACE_EVENTS;
+}
+
+
+/* PROF WRITE TRACE
+ * Writes every recorded phase as a Chrome trace event, for chrome://tracing or Perfetto
+ * Times are microseconds from when profiling started, returns -1 if the file couldn't be written
+ */
+
+int prof_write_trace(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    perror(path);
+    return -1;
+  }
+
+  long n = prof_trace_events();
+  fprintf(file, "{\"traceEvents\":[\n");
+  for (long i = 0; i < n; i++) {
+    const TraceEvent *e = &prof.events[i];
+    fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n", phase_names[e->phase],
+            e->lane+1, (e->start - prof.origin) / 1000.0, (e->end - e->start) / 1000.0, i+1 < n ? "," : "");
+  }
+  fprintf(file, "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%ld}}\n", prof.n_events - n);
+
+  int status = ferror(file) ? -1 : 0;
+  if (fclose(file) != 0) { status = -1; }
+  return status;
+}
+
+void prof_free() {
+  free(prof.events);
+  prof.events = NULL;
+}
@@ -0,0 +1,65 @@
+#include "utils.h"
+#include "sched.h"
+#include "render.h"
+#include <stdatomic.h>
+
+#ifndef PROF_H
+#define PROF_H
+
+// Latencies are bucketed by powers of two split into 4, bucket 4*b + s holds [2^b * (4+s)/4, 2^b * (5+s)/4) ns
+#define PROF_SUBBUCKETS 4
+#define PROF_BUCKETS (32 * PROF_SUBBUCKETS)
+#define MAX_TRACE_EVENTS (1 << 20)
+
+enum Phase { PH_WAIT, PH_INPUT, PH_GAME_INPUT, PH_PHYSICS, PH_DRAW, PH_PRESENT, PH_SPECTATE, PH_FRAME, N_PHASES };
+
+typedef struct PhaseStats {
+  long count;
+  long long total, max;
+  long hist[PROF_BUCKETS];
+} PhaseStats;
+
+// lane is which thread the phase ran on, so each gets its own row in a trace
+typedef struct TraceEvent {
+  int phase;
+  int lane;
+  long long start, end;
+} TraceEvent;
+
+/* Timings for each phase of the game loop
+ * Off unless asked for, and then every prof_begin()/prof_end() pair is just a check of enabled, so it stays built in
+ * Each phase is only ever timed on one thread at a time, trace events are shared and claimed with an atomic counter
+ */
+typedef struct Profiler {
+  _Atomic int enabled;
+  int tracing;
+  long long origin;
+  PhaseStats phases[N_PHASES];
+  TraceEvent *events;
+  _Atomic long n_events;
+} Profiler;
+
+extern Profiler prof;
+extern _Thread_local int prof_lane;
+
+void prof_init(int enabled, int tracing);
+void prof_record(enum Phase phase, long long start, long long end);
+long long prof_percentile(const PhaseStats *stats, double q);
+void prof_overlay(Surface *surf);
+void prof_report(FILE *out);
+long prof_trace_events();
+int prof_write_trace(const char *path);
+void prof_free();
+
+// Start and end of a timed phase, use as  long long t = prof_begin(); ... prof_end(PH_X, t);
+static inline long long prof_begin() {
+  return prof.enabled ? now_ns() : 0;
+}
+
+static inline void prof_end(enum Phase phase, long long start) {
+  if (prof.enabled) {
+    prof_record(phase, start, now_ns());
+  }
+}
+
+#endif
@@ -0,0 +1,283 @@
+#include "render.h"
+#include <stdarg.h>
+
+
+// Makes a window with ncurses, or when term is set, a rectangle of the terminal's cells at the same place
+Surface new_surface(Term *term, int h, int w, int top, int left) {
+  Surface surf = { NULL, term, top, left, h, w, 0 };
+  if (!term) {
+    surf.win = newwin(h, w, top, left);
+  }
+  return surf;
+}
+
+void surf_colour(Surface *surf, int colour) {
+  surf->colour = colour;
+  if (surf->win) {
+    wcolour(surf->win, colour);
+  }
+}
+
+// Puts a single glyph in the current colour, without going through any format parsing
+void surf_put(Surface *surf, int y, int x, wchar_t ch) {
+  if (surf->term) {
+    if (y >= 0 && y < surf->h && x >= 0 && x < surf->w) {
+      term_put(surf->term, surf->top + y, surf->left + x, ch, surf->colour);
+    }
+    return;
+  }
+
+  cchar_t glyph;
+  wchar_t str[] = { ch, L'\0' };
+  setcchar(&glyph, str, 0, surf->colour, NULL);
+  mvwadd_wch(surf->win, y, x, &glyph);
+}
+
+// Decodes one UTF-8 character from *str and moves past it
+static wchar_t next_char(const char **str) {
+  const unsigned char *s = (const unsigned char *)*str;
+  wchar_t c;
+  int extra;
+  if (s[0] < 0x80)      { c = s[0];        extra = 0; }
+  else if (s[0] < 0xE0) { c = s[0] & 0x1F; extra = 1; }
+  else if (s[0] < 0xF0) { c = s[0] & 0x0F; extra = 2; }
+  else                  { c = s[0] & 0x07; extra = 3; }
+
+  int i = 1;
+  for (; i <= extra && (s[i] & 0xC0) == 0x80; i++) {
+    c = c<<6 | (s[i] & 0x3F);
+  }
+  *str += i;
+  return c;
+}
+
+
+/* SURF PRINT
+ * printf into the surface, text running off the right edge carries on at the start of the next line like it does
+ * with mvwprintw, which is what lets create_ui() print the whole HUD as one string
+ */
+
+void surf_print(Surface *surf, int y, int x, const char *fmt, ...) {
+  char text[4096];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(text, sizeof text, fmt, args);
+  va_end(args);
+
+  if (!surf->term) {
+    mvwaddstr(surf->win, y, x, text);
+    return;
+  }
+
+  const char *s = text;
+  while (*s && y < surf->h) {
+    surf_put(surf, y, x, next_char(&s));
+    if (++x >= surf->w) {
+      x = 0;
+      y++;
+    }
+  }
+}
+
+void surf_erase(Surface *surf) {
+  if (!surf->term) {
+    werase(surf->win);
+    return;
+  }
+
+  for (int y = 0; y < surf->h; y++) {
+    for (int x = 0; x < surf->w; x++) {
+      term_put(surf->term, surf->top + y, surf->left + x, L' ', 0);
+    }
+  }
+}
+
+void surf_box(Surface *surf) {
+  if (!surf->term) {
+    box(surf->win, 0, 0);
+    return;
+  }
+
+  for (int x = 1; x < surf->w-1; x++) {
+    surf_put(surf, 0, x, L'─');
+    surf_put(surf, surf->h-1, x, L'─');
+  }
+  for (int y = 1; y < surf->h-1; y++) {
+    surf_put(surf, y, 0, L'│');
+    surf_put(surf, y, surf->w-1, L'│');
+  }
+  surf_put(surf, 0, 0, L'┌');
+  surf_put(surf, 0, surf->w-1, L'┐');
+  surf_put(surf, surf->h-1, 0, L'└');
+  surf_put(surf, surf->h-1, surf->w-1, L'┘');
+}
+
+// Marks the surface as ready to go out with the next present, the terminal backend keeps everything in one buffer anyway
+void surf_refresh(Surface *surf) {
+  if (surf->win) {
+    wnoutrefresh(surf->win);
+  }
+}
+
+// Sends everything drawn since the last present to the screen
+void surf_present(Surface *surf) {
+  if (surf->term) {
+    term_present(surf->term);
+  }
+  else {
+    doupdate();
+  }
+}
+
+
+void view_init(ArenaView *view, Surface *surf, int h, int w) {
+  *view = (ArenaView){ .surf = surf, .h = h, .w = w, .frame = 0, .fresh = true };
+  view->drawn = calloc(h*w, sizeof(Cell));
+  view->next  = calloc(h*w, sizeof(Cell));
+  view->stamp = calloc(h*w, sizeof(int));
+  view->prev  = malloc(h*w * sizeof(int));
+  view->cur   = malloc(h*w * sizeof(int));
+}
+
+void view_free(ArenaView *view) {
+  free(view->drawn);
+  free(view->next);
+  free(view->stamp);
+  free(view->prev);
+  free(view->cur);
+}
+
+// Forgets what is on screen, for when something else (like the menu) has drawn over the window
+void view_invalidate(ArenaView *view) {
+  view->fresh = true;
+}
+
+void view_begin(ArenaView *view) {
+  view->frame++;
+  view->n_cur = 0;
+}
+
+// Queues a glyph for this frame, later puts to the same cell win, and nothing is allowed on the border
+void view_put(ArenaView *view, int y, int x, wchar_t ch, int colour) {
+  if (y < 1 || y >= view->h-1 || x < 1 || x >= view->w-1) {
+    return;
+  }
+
+  int cell = y * view->w + x;
+  if (view->stamp[cell] != view->frame) {
+    view->stamp[cell] = view->frame;
+    view->cur[view->n_cur++] = cell;
+  }
+  view->next[cell] = (Cell){ch, colour};
+}
+
+static void write_cell(ArenaView *view, int cell, Cell c) {
+  surf_colour(view->surf, c.colour);
+  surf_put(view->surf, cell / view->w, cell % view->w, c.ch);
+}
+
+
+/* VIEW END
+ * Sends the difference between this frame and the last one to the window
+ * After an invalidate the whole window is cleared and the border redrawn, otherwise the work only depends on
+ * how many cells the two frames touched
+ */
+
+void view_end(ArenaView *view) {
+  if (view->fresh) {
+    surf_erase(view->surf);
+    surf_colour(view->surf, 1);
+    surf_box(view->surf);
+    surf_print(view->surf, 0, 4, "┤ SPACEWAR! ├");
+    memset(view->drawn, 0, view->h * view->w * sizeof(Cell));
+    view->n_prev = 0;
+    view->fresh = false;
+  }
+
+  // Blank anything that was drawn last frame but not this one
+  for (int i = 0; i < view->n_prev; i++) {
+    int cell = view->prev[i];
+    if (view->stamp[cell] != view->frame) {
+      write_cell(view, cell, (Cell){L' ', 1});
+      view->drawn[cell] = (Cell){0, 0};
+    }
+  }
+
+  for (int i = 0; i < view->n_cur; i++) {
+    int cell = view->cur[i];
+    Cell c = view->next[cell];
+    if (view->drawn[cell].ch != c.ch || view->drawn[cell].colour != c.colour) {
+      write_cell(view, cell, c);
+      view->drawn[cell] = c;
+    }
+  }
+
+  int *swap = view->prev;
+  view->prev = view->cur;
+  view->cur = swap;
+  view->n_prev = view->n_cur;
+
+  surf_colour(view->surf, 1);
+  surf_refresh(view->surf);
+}
+
+
+// Where a camera wants its top left along one axis, centred on target unless the arena fits, and snapped to whole cells
+static double camera_axis(double target, double view, int arena, double cell) {
+  if (arena <= view) {
+    return 0;
+  }
+  double start = fmod(target - view/2, arena);
+  if (start < 0) { start += arena; }
+  return floor(start / cell) * cell;
+}
+
+/* CAMERA FOLLOW
+ * Points the camera at player 1, player 2, or halfway between them the short way round the arena
+ * The window shows rows*2 by cols physics units, anything further than that from the top left is off screen
+ */
+
+void camera_follow(Camera *cam, const GameState *game, const ArenaView *view) {
+  cam->rows = view->h - 2;
+  cam->cols = view->w - 2;
+  cam->arena_h = game->arena_h;
+  cam->arena_w = game->arena_w;
+
+  const ObjectData *p1 = &game->players[0].data;
+  const ObjectData *p2 = &game->players[1].data;
+  double y, x;
+  switch (cam->mode) {
+    case CAM_P1: y = p1->y; x = p1->x; break;
+    case CAM_P2: y = p2->y; x = p2->x; break;
+    default: {
+      double dy = p2->y - p1->y;
+      double dx = p2->x - p1->x;
+      if (dy > game->arena_h/2.0) { dy -= game->arena_h; }
+      else if (dy < -game->arena_h/2.0) { dy += game->arena_h; }
+      if (dx > game->arena_w/2.0) { dx -= game->arena_w; }
+      else if (dx < -game->arena_w/2.0) { dx += game->arena_w; }
+      y = p1->y + dy/2;
+      x = p1->x + dx/2;
+    }
+  }
+
+  cam->top = camera_axis(y - ARENA_TOP, 2*cam->rows, game->arena_h, 2);
+  cam->left = camera_axis(x - ARENA_LEFT, cam->cols, game->arena_w, 1);
+}
+
+// Finds the window cell a point in the arena lands in, returns false (culled) if the camera can't see it
+int camera_cell(const Camera *cam, double y, double x, int *row, int *col) {
+  double ry = y - ARENA_TOP - cam->top;
+  double rx = x - ARENA_LEFT - cam->left;
+  if (ry < 0) { ry += cam->arena_h; }
+  else if (ry >= cam->arena_h) { ry -= cam->arena_h; }
+  if (rx < 0) { rx += cam->arena_w; }
+  else if (rx >= cam->arena_w) { rx -= cam->arena_w; }
+
+  if (ry < 0 || ry >= 2*cam->rows || rx < 0 || rx >= cam->cols) {
+    return false;
+  }
+  *row = 1 + (int)(ry / 2);
+  *col = 1 + (int)rx;
+  return true;
+}
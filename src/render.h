@@ -0,0 +1,66 @@
+#include "game.h"
+#include "term.h"
+
+#ifndef RENDER_H
+#define RENDER_H
+
+/* Somewhere to draw, either an ncurses window or a rectangle of the direct ANSI terminal
+ * Everything on screen goes through the surf_ functions, so the game draws the same way on both backends
+ */
+typedef struct Surface {
+  WINDOW *win;
+  Term *term;
+  int top, left;
+  int h, w;
+  short colour;
+} Surface;
+
+/* Retained mode drawing of the game window
+ * Remembers which cells it drew last frame, so a new frame only blanks the cells objects moved away from
+ * and only writes cells whose glyph or colour changed. The border is drawn once and then left alone
+ * drawn is what is on screen, next and the stamps collect this frame, and the lists hold the cells each frame touched
+ */
+typedef struct ArenaView {
+  Surface *surf;
+  int h, w;
+  int frame;
+  int fresh;
+  Cell *drawn, *next;
+  int *stamp;
+  int *prev, *cur;
+  int n_prev, n_cur;
+} ArenaView;
+
+enum CameraMode { CAM_BOTH, CAM_P1, CAM_P2, CAM_MODES };
+
+/* Which part of the arena the game window shows, for arenas bigger than the window
+ * top and left are where the first cell inside the border is, in physics units from the arena's top left corner
+ * Along any axis the arena fits in, the camera stays put at 0 so the arena is drawn exactly as it always was
+ */
+typedef struct Camera {
+  int mode;
+  double top, left;
+  int rows, cols;
+  int arena_h, arena_w;
+} Camera;
+
+Surface new_surface(Term *term, int h, int w, int top, int left);
+void surf_colour(Surface *surf, int colour);
+void surf_put(Surface *surf, int y, int x, wchar_t ch);
+void surf_print(Surface *surf, int y, int x, const char *fmt, ...);
+void surf_erase(Surface *surf);
+void surf_box(Surface *surf);
+void surf_refresh(Surface *surf);
+void surf_present(Surface *surf);
+
+void view_init(ArenaView *view, Surface *surf, int h, int w);
+void view_free(ArenaView *view);
+void view_invalidate(ArenaView *view);
+void view_begin(ArenaView *view);
+void view_put(ArenaView *view, int y, int x, wchar_t ch, int colour);
+void view_end(ArenaView *view);
+
+void camera_follow(Camera *cam, const GameState *game, const ArenaView *view);
+int camera_cell(const Camera *cam, double y, double x, int *row, int *col);
+
+#endif
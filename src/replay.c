@@ -0,0 +1,364 @@
+#include "replay.h"
+#include "serial.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define REPLAY_MAGIC "SWRP"
+#define INDEX_MAGIC "SWRX"
+#define TRAILER_SIZE 12
+
+
+static void rec_write(Recorder *rec, const unsigned char *bytes, size_t len) {
+  fwrite(bytes, 1, len, rec->file);
+  rec->offset += len;
+}
+
+static void rec_snapshot(Recorder *rec, const GameState *game) {
+  if (rec->n_marks == rec->cap_marks) {
+    rec->cap_marks = rec->cap_marks ? rec->cap_marks*2 : 64;
+    rec->marks = realloc(rec->marks, rec->cap_marks * sizeof(ReplayMark));
+  }
+  rec->marks[rec->n_marks++] = (ReplayMark){game->tick, rec->offset};
+
+  unsigned char head[20];
+  size_t state_len = pack_state(game, rec->buf);
+  size_t len = put_varint(head, (uint64_t)(game->tick - rec->last_tick) << 3);
+  len += put_varint(head+len, state_len);
+  rec_write(rec, head, len);
+  rec_write(rec, rec->buf, state_len);
+
+  rec->last_tick = game->tick;
+  rec->next_snapshot = game->tick + rec->interval;
+}
+
+
+/* REC OPEN
+ * Starts a replay file for a match that begins from the given state, with a snapshot every interval ticks
+ * Returns -1 if the file can't be created
+ */
+
+int rec_open(Recorder *rec, const char *path, const GameState *game, int interval) {
+  *rec = (Recorder){0};
+  rec->file = fopen(path, "wb");
+  if (!rec->file) {
+    return -1;
+  }
+  rec->interval = interval > 0 ? interval : SNAPSHOT_INTERVAL;
+  rec->buf = malloc(STATE_MAX_BYTES);
+  rec->last_tick = game->tick;
+
+  unsigned char header[24];
+  memcpy(header, REPLAY_MAGIC, 4);
+  size_t len = 4;
+  header[len++] = REPLAY_VERSION;
+  len += put_varint(header+len, TICK_RATE);
+  len += put_varint(header+len, rec->interval);
+  rec_write(rec, header, len);
+
+  rec_snapshot(rec, game);
+  return 0;
+}
+
+// Logs a batch of keys, in the same ERR terminated form handle_game_inputs() takes, just before it is given them
+void rec_keys(Recorder *rec, const GameState *game, int keys[]) {
+  int n = 0;
+  while (n < 7 && keys[n] != ERR) { n++; }
+  if (n == 0) {
+    return;
+  }
+
+  unsigned char bytes[10 + 7*10];
+  size_t len = put_varint(bytes, (uint64_t)(game->tick - rec->last_tick) << 3 | n);
+  for (int i = 0; i < n; i++) {
+    len += put_varint(bytes+len, keys[i]);
+  }
+  rec_write(rec, bytes, len);
+  rec->last_tick = game->tick;
+}
+
+// Call after every physics tick, stores a snapshot whenever one is due
+void rec_tick(Recorder *rec, const GameState *game) {
+  if (game->tick >= rec->next_snapshot) {
+    rec_snapshot(rec, game);
+  }
+}
+
+
+/* REC CLOSE
+ * Ends the match with a snapshot of the final state, then writes the snapshot index and the trailer that points at it
+ * Returns -1 if anything failed to write
+ */
+
+int rec_close(Recorder *rec, const GameState *game) {
+  rec_snapshot(rec, game);
+
+  long index = rec->offset;
+  unsigned char bytes[24];
+  rec_write(rec, bytes, put_varint(bytes, rec->n_marks));
+  for (int i = 0; i < rec->n_marks; i++) {
+    ReplayMark prev = i ? rec->marks[i-1] : (ReplayMark){0, 0};
+    size_t len = put_varint(bytes, rec->marks[i].tick - prev.tick);
+    len += put_varint(bytes+len, rec->marks[i].offset - prev.offset);
+    rec_write(rec, bytes, len);
+  }
+
+  put_u64(bytes, index);
+  memcpy(bytes+8, INDEX_MAGIC, 4);
+  rec_write(rec, bytes, TRAILER_SIZE);
+
+  int status = ferror(rec->file) ? -1 : 0;
+  if (fclose(rec->file) != 0) { status = -1; }
+  free(rec->marks);
+  free(rec->buf);
+  *rec = (Recorder){0};
+  return status;
+}
+
+
+// Restores the snapshot a mark points at and carries on reading from just after it
+static int load_mark(Replay *replay, int m) {
+  Reader in = { replay->data + replay->marks[m].offset, replay->data + replay->stream_end, false };
+  uint64_t head = get_varint(&in);
+  uint64_t len = get_varint(&in);
+  if (in.bad || (head & 7) || len > (uint64_t)(in.end - in.pos) || unpack_state(&replay->game, in.pos, len) < 0) {
+    return -1;
+  }
+  replay->pos = in.pos + len - replay->data;
+  replay->record_tick = replay->marks[m].tick;
+  return 0;
+}
+
+
+/* REPLAY OPEN
+ * Maps a replay file, reads its index from the trailer and restores the first snapshot
+ * Returns -1 and says why if the file is missing, from another version, or damaged
+ */
+
+int replay_open(Replay *replay, const char *path) {
+  replay->data = NULL;
+  replay->marks = NULL;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  struct stat info;
+  if (fstat(fd, &info) < 0 || info.st_size < 5 + TRAILER_SIZE) {
+    fprintf(stderr, "%s: not a replay\n", path);
+    close(fd);
+    return -1;
+  }
+  replay->size = info.st_size;
+  void *data = mmap(NULL, replay->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror(path);
+    return -1;
+  }
+  replay->data = data;
+
+  const unsigned char *trailer = replay->data + replay->size - TRAILER_SIZE;
+  if (memcmp(replay->data, REPLAY_MAGIC, 4) != 0 || memcmp(trailer+8, INDEX_MAGIC, 4) != 0) {
+    fprintf(stderr, "%s: not a replay, or it was never finished\n", path);
+    replay_close(replay);
+    return -1;
+  }
+  if (replay->data[4] != REPLAY_VERSION) {
+    fprintf(stderr, "%s: replay version %d, this build reads %d\n", path, replay->data[4], REPLAY_VERSION);
+    replay_close(replay);
+    return -1;
+  }
+
+  Reader in = { replay->data + 5, trailer, false };
+  long tick_rate = get_varint(&in);
+  replay->interval = get_varint(&in);
+  replay->stream_end = get_u64(&(Reader){ trailer, trailer + 8, false });
+  if (in.bad || tick_rate != TICK_RATE || replay->stream_end >= replay->size - TRAILER_SIZE) {
+    fprintf(stderr, "%s: damaged or recorded at a different tick rate\n", path);
+    replay_close(replay);
+    return -1;
+  }
+
+  in = (Reader){ replay->data + replay->stream_end, trailer, false };
+  replay->n_marks = get_varint(&in);
+  if (in.bad || replay->n_marks < 1 || replay->n_marks > in.end - in.pos) {
+    fprintf(stderr, "%s: damaged snapshot index\n", path);
+    replay_close(replay);
+    return -1;
+  }
+  replay->marks = malloc(replay->n_marks * sizeof(ReplayMark));
+  ReplayMark prev = {0, 0};
+  for (int i = 0; i < replay->n_marks; i++) {
+    prev.tick += get_varint(&in);
+    prev.offset += get_varint(&in);
+    replay->marks[i] = prev;
+    if (prev.offset < 5 || (size_t)prev.offset >= replay->stream_end) { in.bad = true; }
+  }
+
+  replay->start_tick = replay->marks[0].tick;
+  replay->end_tick = replay->marks[replay->n_marks-1].tick;
+  replay->checked = 0;
+  replay->desyncs = 0;
+  if (in.bad || load_mark(replay, 0) < 0) {
+    fprintf(stderr, "%s: damaged snapshot index\n", path);
+    replay_close(replay);
+    return -1;
+  }
+  return 0;
+}
+
+void replay_close(Replay *replay) {
+  if (replay->data) {
+    munmap((void *)replay->data, replay->size);
+  }
+  free(replay->marks);
+  replay->data = NULL;
+  replay->marks = NULL;
+}
+
+
+/* APPLY RECORDS
+ * Plays every record for the tick the game is on, in the order they were written
+ * Keys go to handle_game_inputs(), snapshots are compared with the game's own state to catch any drift
+ * A damaged record ends the replay there
+ */
+
+static void apply_records(Replay *replay) {
+  static _Thread_local unsigned char *packed;
+  if (!packed) { packed = malloc(STATE_MAX_BYTES); }
+
+  int damaged = false;
+  while (replay->pos < replay->stream_end) {
+    Reader in = { replay->data + replay->pos, replay->data + replay->stream_end, false };
+    uint64_t head = get_varint(&in);
+    long tick = replay->record_tick + (head >> 3);
+    if (tick > replay->game.tick) {
+      break;
+    }
+
+    int n = head & 7;
+    if (n == 0) {
+      uint64_t len = get_varint(&in);
+      if (in.bad || len > (uint64_t)(in.end - in.pos)) { damaged = true; break; }
+      size_t have = pack_state(&replay->game, packed);
+      replay->checked++;
+      if (have != len || memcmp(packed, in.pos, len) != 0) { replay->desyncs++; }
+      in.pos += len;
+    }
+    else {
+      int keys[8];
+      for (int i = 0; i < n; i++) { keys[i] = get_varint(&in); }
+      keys[n] = ERR;
+      if (in.bad) { damaged = true; break; }
+
+      int pause_toggle = false;
+      handle_game_inputs(&replay->game, keys, &pause_toggle);
+    }
+
+    replay->pos = in.pos - replay->data;
+    replay->record_tick = tick;
+  }
+
+  if (damaged) {
+    replay->end_tick = replay->game.tick;
+    replay->pos = replay->stream_end;
+  }
+}
+
+// Plays one tick, returns false once the end of the match has been reached
+int replay_step(Replay *replay) {
+  apply_records(replay);
+  if (replay->game.tick >= replay->end_tick) {
+    return false;
+  }
+  update_physics(&replay->game, 1);
+  return true;
+}
+
+
+/* REPLAY SEEK
+ * Moves to the start of the given tick, clamped to the match
+ * Restores the last snapshot at or before it, unless the replay is already between that snapshot and the tick,
+ * and simulates forward from there, so a seek never costs more than one snapshot interval of ticks
+ */
+
+int replay_seek(Replay *replay, long tick) {
+  if (tick < replay->start_tick) { tick = replay->start_tick; }
+  if (tick > replay->end_tick)   { tick = replay->end_tick; }
+
+  int lo = 0;
+  int hi = replay->n_marks-1;
+  while (lo < hi) {
+    int mid = (lo + hi + 1)/2;
+    if (replay->marks[mid].tick <= tick) { lo = mid; }
+    else { hi = mid-1; }
+  }
+
+  if (replay->game.tick > tick || replay->game.tick < replay->marks[lo].tick) {
+    if (load_mark(replay, lo) < 0) {
+      return -1;
+    }
+  }
+  while (replay->game.tick < tick && replay_step(replay));
+  return 0;
+}
+
+
+/* REPLAY MAIN
+ * Usage: spacewar --replay FILE [--from TICK] [--to TICK]
+ * Seeks to --from, then plays to --to (or the end) as fast as possible and prints the result
+ * Exits with 1 if the simulation drifted from any snapshot it passed
+ */
+
+int replay_main(int argc, char *argv[]) {
+  const char *path = NULL;
+  long from = -1;
+  long to = -1;
+
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--from") == 0 && i+1 < argc)    { from = atol(argv[++i]); }
+    else if (strcmp(argv[i], "--to") == 0 && i+1 < argc) { to = atol(argv[++i]); }
+    else { path = argv[i]; }
+  }
+  if (!path) {
+    fprintf(stderr, "usage: spacewar --replay FILE [--from TICK] [--to TICK]\n");
+    return 1;
+  }
+
+  static Replay replay;
+  if (replay_open(&replay, path) < 0) {
+    return 1;
+  }
+
+  printf("%s: ticks %ld-%ld (%.1fs game time), %d snapshots, %zu bytes\n", path, replay.start_tick, replay.end_tick,
+         (double)(replay.end_tick - replay.start_tick) / TICK_RATE, replay.n_marks, replay.size);
+
+  struct timespec start, end;
+  if (from >= 0) {
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    replay_seek(&replay, from);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    printf("seek to tick %d in %.3fms\n", replay.game.tick, ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9) * 1000);
+  }
+
+  long first = replay.game.tick;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+  while ((to < 0 || replay.game.tick < to) && replay_step(&replay));
+  clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  long ticks = replay.game.tick - first;
+
+  int winner = check_winner(&replay.game);
+  printf("P1 SCORE  %05d       P2 SCORE  %05d\n", replay.game.players[0].score, replay.game.players[1].score);
+  if (winner) { printf("PLAYER %d WINS\n", winner); }
+  else        { printf("NO WINNER\n"); }
+  printf("ticks %ld in %.3fs, %.0f steps/s (%.0fx real time)\n", ticks, seconds, ticks / seconds, ticks / seconds / TICK_RATE);
+  printf("snapshots checked %ld, mismatched %ld\n", replay.checked, replay.desyncs);
+
+  int status = replay.desyncs ? 1 : 0;
+  replay_close(&replay);
+  free_physics_scratch();
+  return status;
+}
@@ -0,0 +1,61 @@
+#include "game.h"
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+// How often the recorder stores a full snapshot, which is also how far a seek can have to simulate
+#define SNAPSHOT_INTERVAL (10*TICK_RATE)
+#define REPLAY_VERSION 5
+
+// Where a snapshot record starts in the file, and the tick it restores
+typedef struct ReplayMark {
+  long tick;
+  long offset;
+} ReplayMark;
+
+/* Writes a match to a replay file as it is played
+ * The file is a header, then a stream of records, then an index of the snapshot records and a fixed size trailer
+ * Every record starts with a varint of (ticks since the last record << 3 | n). n of 1 to 7 is a batch of n keys as
+ * varints, given to handle_game_inputs() before that tick is stepped. n of 0 is a snapshot, a varint length and
+ * then pack_state() of the game as that tick begins. The first and last records are always snapshots
+ */
+typedef struct Recorder {
+  FILE *file;
+  long offset;
+  long last_tick, next_snapshot;
+  int interval;
+  ReplayMark *marks;
+  int n_marks, cap_marks;
+  unsigned char *buf;
+} Recorder;
+
+/* A replay file mapped into memory
+ * game is the state at the start of tick game.tick, replay_step() advances it one tick and replay_seek() jumps
+ * to any tick from the nearest snapshot before it. Snapshots passed on the way are checked against the simulation
+ */
+typedef struct Replay {
+  const unsigned char *data;
+  size_t size;
+  size_t stream_end;
+  long start_tick, end_tick;
+  int interval;
+  ReplayMark *marks;
+  int n_marks;
+  size_t pos;
+  long record_tick;
+  long checked, desyncs;
+  GameState game;
+} Replay;
+
+int rec_open(Recorder *rec, const char *path, const GameState *game, int interval);
+void rec_keys(Recorder *rec, const GameState *game, int keys[]);
+void rec_tick(Recorder *rec, const GameState *game);
+int rec_close(Recorder *rec, const GameState *game);
+
+int replay_open(Replay *replay, const char *path);
+void replay_close(Replay *replay);
+int replay_seek(Replay *replay, long tick);
+int replay_step(Replay *replay);
+int replay_main(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,106 @@
+#include "sched.h"
+#include <poll.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/timerfd.h>
+
+
+// Current time on the scheduler's clock, in nanoseconds
+long long now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// Points the timer at an absolute deadline, if it has already passed the timer fires straight away
+static void arm(Scheduler *sched) {
+  struct itimerspec when = {{0, 0}, {sched->next / 1000000000, sched->next % 1000000000}};
+  timerfd_settime(sched->timer, TFD_TIMER_ABSTIME, &when, NULL);
+}
+
+void sched_init(Scheduler *sched, long long period) {
+  *sched = (Scheduler){0};
+  sched->timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  sched->period = period;
+  sched->idle = true;
+}
+
+void sched_close(Scheduler *sched) {
+  close(sched->timer);
+}
+
+
+/* SCHED WAIT
+ * Sleeps until the next frame deadline, or until fd has input to read, whichever comes first
+ * Returns true when a frame is due (with delta set to the time since the last one), false when woken by input
+ * or if waiting failed with anything but an interrupted call
+ * With timed false there are no deadlines at all and it only wakes for input, the next timed wait restarts the clock
+ */
+
+int sched_wait(Scheduler *sched, int fd, int timed) {
+  if (!timed) {
+    sched->idle = true;
+    struct pollfd input = {fd, POLLIN, 0};
+    while (poll(&input, 1, -1) < 0 && errno == EINTR);
+    return false;
+  }
+
+  if (sched->idle) {
+    long long now = now_ns();
+    sched->origin = sched->last = now;
+    sched->next = now + sched->period;
+    sched->origin_frame = sched->frames;
+    sched->origin_skipped = sched->skipped;
+    sched->idle = false;
+    arm(sched);
+  }
+
+  while (true) {
+    struct pollfd fds[2] = {{sched->timer, POLLIN, 0}, {fd, POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      uint64_t expirations;
+      read(sched->timer, &expirations, sizeof expirations);
+
+      long long now = now_ns();
+      long long jitter = now - sched->next;
+      sched->jitter_sum += jitter;
+      if (jitter > sched->jitter_max) { sched->jitter_max = jitter; }
+
+      sched->delta = now - sched->last;
+      sched->last = now;
+      sched->frames++;
+
+      // Deadlines skipped since the origin are still on the grid, so they count towards where this frame should be
+      long slots = sched->frames - sched->origin_frame + sched->skipped - sched->origin_skipped;
+      sched->drift = (now - sched->origin) - slots * sched->period;
+
+      // If we are already past the following deadline too then those frames are lost, stay on the grid but skip them
+      sched->next += sched->period;
+      if (sched->next <= now) {
+        long missed = (now - sched->next) / sched->period + 1;
+        sched->skipped += missed;
+        sched->next += missed * sched->period;
+      }
+
+      arm(sched);
+      return true;
+    }
+
+    if (fds[1].revents) {
+      return false;
+    }
+  }
+}
+
+// Prints a one line summary of how closely frames kept to their deadlines
+void sched_report(Scheduler *sched, FILE *out) {
+  fprintf(out, "frames %ld, skipped %ld, jitter mean %.3fms max %.3fms, drift %.3fms\n",
+    sched->frames, sched->skipped,
+    sched->frames ? (double)sched->jitter_sum / sched->frames / 1e6 : 0,
+    sched->jitter_max / 1e6, sched->drift / 1e6);
+}
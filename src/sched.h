@@ -0,0 +1,26 @@
+#include "utils.h"
+
+#ifndef SCHED_H
+#define SCHED_H
+
+/* Frame scheduler, sleeps on a timerfd armed at absolute deadlines instead of spinning on the clock
+ * Times are nanoseconds on CLOCK_MONOTONIC
+ */
+typedef struct Scheduler {
+  int timer;
+  int idle;
+  long long period;
+  long long origin, last, next;
+  long long delta;
+  long frames, origin_frame, skipped, origin_skipped;
+  long long jitter_sum, jitter_max;
+  long long drift;
+} Scheduler;
+
+long long now_ns();
+void sched_init(Scheduler *sched, long long period);
+void sched_close(Scheduler *sched);
+int sched_wait(Scheduler *sched, int fd, int timed);
+void sched_report(Scheduler *sched, FILE *out);
+
+#endif
@@ -0,0 +1,287 @@
+#include "serial.h"
+
+
+// Unsigned LEB128, 7 bits a byte with the high bit set on every byte but the last
+size_t put_varint(unsigned char *out, uint64_t value) {
+  size_t len = 0;
+  while (value >= 0x80) {
+    out[len++] = (value & 0x7F) | 0x80;
+    value >>= 7;
+  }
+  out[len++] = value;
+  return len;
+}
+
+// Zigzag encoded so small negative numbers (like ERR) stay one byte too
+size_t put_int(unsigned char *out, long value) {
+  return put_varint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+// Always little endian, whatever the machine
+size_t put_u64(unsigned char *out, uint64_t value) {
+  for (int i = 0; i < 8; i++) {
+    out[i] = value >> 8*i;
+  }
+  return 8;
+}
+
+size_t put_double(unsigned char *out, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, 8);
+  return put_u64(out, bits);
+}
+
+uint64_t get_varint(Reader *in) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (in->pos >= in->end) { break; }
+    unsigned char byte = *in->pos++;
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) { return value; }
+  }
+  in->bad = true;
+  return 0;
+}
+
+long get_int(Reader *in) {
+  uint64_t value = get_varint(in);
+  return (long)(value >> 1) ^ -(long)(value & 1);
+}
+
+uint64_t get_u64(Reader *in) {
+  if (in->end - in->pos < 8) {
+    in->bad = true;
+    return 0;
+  }
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    value |= (uint64_t)in->pos[i] << 8*i;
+  }
+  in->pos += 8;
+  return value;
+}
+
+double get_double(Reader *in) {
+  uint64_t bits = get_u64(in);
+  double value;
+  memcpy(&value, &bits, 8);
+  return value;
+}
+
+
+static size_t put_object(unsigned char *out, const ObjectData *data) {
+  const double fields[] = { data->y, data->x, data->y1, data->x1, data->y2, data->x2, data->y3, data->x3, data->vely, data->velx };
+  size_t len = 0;
+  for (int i = 0; i < 10; i++) {
+    len += put_double(out+len, fields[i]);
+  }
+  return len;
+}
+
+static ObjectData get_object(Reader *in) {
+  ObjectData data;
+  double *fields[] = { &data.y, &data.x, &data.y1, &data.x1, &data.y2, &data.x2, &data.y3, &data.x3, &data.vely, &data.velx };
+  for (int i = 0; i < 10; i++) {
+    *fields[i] = get_double(in);
+  }
+  return data;
+}
+
+
+/* PACK STATE
+ * Writes everything a match needs to carry on exactly as it was, field by field so struct padding never ends up
+ * in the output, and only the live part of each table, all little endian whatever the machine
+ * Returns the number of bytes written, at most STATE_MAX_BYTES
+ * The torpedo pool goes exactly as it is, free list and generations included, and the order of alive is rebuilt from
+ * the live slots' links, so a restored match hands out the same slots and visits torpedoes in the same order
+ */
+
+size_t pack_state(const GameState *game, unsigned char *out) {
+  size_t len = 0;
+  len += put_int(out+len, game->n_wells);
+  len += put_int(out+len, game->n_players);
+  len += put_int(out+len, game->n_bullets);
+  len += put_int(out+len, game->n_alive);
+  len += put_int(out+len, game->free_bullet);
+  len += put_int(out+len, game->torpedo_limit);
+  len += put_int(out+len, game->tick);
+  len += put_double(out+len, game->ship_mass);
+  len += put_double(out+len, game->theta);
+  len += put_int(out+len, game->torpedo_gravity);
+  len += put_int(out+len, game->fixed_point);
+  len += put_int(out+len, game->arena_h);
+  len += put_int(out+len, game->arena_w);
+  len += put_u64(out+len, game->rng);
+
+  for (int i = 0; i < game->n_wells; i++) {
+    len += put_double(out+len, game->wells[i].y);
+    len += put_double(out+len, game->wells[i].x);
+    len += put_double(out+len, game->wells[i].mass);
+  }
+
+  for (int i = 0; i < game->n_players; i++) {
+    const Player *p = &game->players[i];
+    uint32_t temp;
+    memcpy(&temp, &p->temp, 4);
+    len += put_int(out+len, p->type);
+    len += put_object(out+len, &p->data);
+    for (int b = 0; b < 4; b++) {
+      out[len++] = temp >> 8*b;
+    }
+    len += put_int(out+len, p->acc);
+    len += put_int(out+len, p->dir);
+    len += put_int(out+len, p->score);
+    len += put_double(out+len, p->spawn_y);
+    len += put_double(out+len, p->spawn_x);
+    len += put_int(out+len, p->spawn_dir);
+    len += put_int(out+len, p->torpedoes);
+    len += put_int(out+len, p->torpedo);
+  }
+
+  for (int i = 0; i < game->n_bullets; i++) {
+    const Bullet *b = &game->bullets[i];
+    len += put_int(out+len, b->type);
+    len += put_int(out+len, b->link);
+    len += put_int(out+len, b->gen);
+    if ((int)b->type == ERR) { continue; }
+    len += put_object(out+len, &b->data);
+    len += put_int(out+len, b->fuse);
+    len += put_int(out+len, b->owner);
+  }
+
+  return len;
+}
+
+
+// The reverse of pack_state(), returns -1 without touching game if the bytes are cut short or out of range
+int unpack_state(GameState *game, const unsigned char *in, size_t len) {
+  static _Thread_local GameState next;
+  Reader r = { in, in+len, false };
+
+  next.n_wells = get_int(&r);
+  next.n_players = get_int(&r);
+  next.n_bullets = get_int(&r);
+  next.n_alive = get_int(&r);
+  next.free_bullet = get_int(&r);
+  next.torpedo_limit = get_int(&r);
+  next.tick = get_int(&r);
+  // The screen always shows two ships, so a match never has fewer
+  if (next.n_wells < 0 || next.n_wells > MAX_WELLS || next.n_players < 2 || next.n_players > MAX_PLAYERS
+      || next.n_bullets < 0 || next.n_bullets > MAX_BULLETS || next.n_alive < 0 || next.n_alive > next.n_bullets
+      || next.free_bullet < -1 || next.free_bullet >= next.n_bullets) {
+    return -1;
+  }
+  next.ship_mass = get_double(&r);
+  next.theta = get_double(&r);
+  next.torpedo_gravity = get_int(&r);
+  next.fixed_point = get_int(&r);
+  next.arena_h = get_int(&r);
+  next.arena_w = get_int(&r);
+  if (next.arena_h < 1 || next.arena_h > 2*MAX_WORLD || next.arena_w < 1 || next.arena_w > MAX_WORLD) {
+    return -1;
+  }
+  next.rng = get_u64(&r);
+
+  for (int i = 0; i < next.n_wells; i++) {
+    next.wells[i].y = get_double(&r);
+    next.wells[i].x = get_double(&r);
+    next.wells[i].mass = get_double(&r);
+  }
+
+  for (int i = 0; i < next.n_players && !r.bad; i++) {
+    Player *p = &next.players[i];
+    p->type = get_int(&r);
+    p->data = get_object(&r);
+    if (r.end - r.pos < 4) { return -1; }
+    uint32_t temp = 0;
+    for (int b = 0; b < 4; b++) {
+      temp |= (uint32_t)r.pos[b] << 8*b;
+    }
+    memcpy(&p->temp, &temp, 4);
+    r.pos += 4;
+    p->acc = get_int(&r);
+    p->dir = get_int(&r);
+    p->score = get_int(&r);
+    p->spawn_y = get_double(&r);
+    p->spawn_x = get_double(&r);
+    p->spawn_dir = get_int(&r);
+    p->torpedoes = get_int(&r);
+    p->torpedo = get_int(&r);
+    if (p->dir < N || p->dir > NW || p->spawn_dir < N || p->spawn_dir > NW) {
+      return -1;
+    }
+  }
+
+  // Every live slot has to claim its own place in alive, and every link has to stay inside the pool
+  int n_live = 0;
+  for (int i = 0; i < next.n_alive; i++) {
+    next.alive[i] = -1;
+  }
+  for (int i = 0; i < next.n_bullets && !r.bad; i++) {
+    Bullet *b = &next.bullets[i];
+    int type = get_int(&r);
+    int link = get_int(&r);
+    unsigned gen = get_int(&r);
+    if (type == ERR) {
+      *b = err_bullet();
+      b->link = link;
+      b->gen = gen;
+      if (link < -1 || link >= next.n_bullets) { return -1; }
+      continue;
+    }
+    b->type = type;
+    b->link = link;
+    b->gen = gen;
+    b->data = get_object(&r);
+    b->fuse = get_int(&r);
+    b->owner = get_int(&r);
+    if (type != BULLET || link < 0 || link >= next.n_alive || next.alive[link] >= 0 || b->owner < 0 || b->owner >= next.n_players) {
+      return -1;
+    }
+    next.alive[link] = i;
+    n_live++;
+  }
+  if (r.bad || r.pos != r.end || n_live != next.n_alive) {
+    return -1;
+  }
+
+  // The free list can only pass through empty slots, each at most once, or a spawn would land on a live torpedo
+  int n_free = 0;
+  for (int slot = next.free_bullet; slot >= 0; slot = next.bullets[slot].link) {
+    if (next.bullets[slot].type == BULLET || ++n_free > next.n_bullets - n_live) {
+      return -1;
+    }
+  }
+
+  // Only the live part is copied, the rest of the tables is left as it was
+  game->n_wells = next.n_wells;
+  game->n_players = next.n_players;
+  game->n_bullets = next.n_bullets;
+  game->n_alive = next.n_alive;
+  game->free_bullet = next.free_bullet;
+  game->torpedo_limit = next.torpedo_limit;
+  game->tick = next.tick;
+  game->ship_mass = next.ship_mass;
+  game->theta = next.theta;
+  game->torpedo_gravity = next.torpedo_gravity;
+  game->fixed_point = next.fixed_point;
+  game->arena_h = next.arena_h;
+  game->arena_w = next.arena_w;
+  game->rng = next.rng;
+  memcpy(game->wells, next.wells, next.n_wells * sizeof(BlackHole));
+  memcpy(game->players, next.players, next.n_players * sizeof(Player));
+  memcpy(game->bullets, next.bullets, next.n_bullets * sizeof(Bullet));
+  memcpy(game->alive, next.alive, next.n_alive * sizeof(int));
+  return 0;
+}
+
+
+// 64 bit FNV-1a, for telling whether two packed states are the same without keeping both around
+uint64_t hash_bytes(const unsigned char *bytes, size_t len) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
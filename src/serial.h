@@ -0,0 +1,30 @@
+#include "utils.h"
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+// Upper bound on pack_state()'s output, a varint is at most 10 bytes and each double or float is written raw
+#define STATE_MAX_BYTES (96 + MAX_WELLS*24 + MAX_PLAYERS*128 + MAX_BULLETS*112)
+
+/* Reads from a byte range, a read that would run past the end sets bad instead and returns 0
+ * so a run of reads can be checked once at the end
+ */
+typedef struct Reader {
+  const unsigned char *pos, *end;
+  int bad;
+} Reader;
+
+size_t put_varint(unsigned char *out, uint64_t value);
+size_t put_int(unsigned char *out, long value);
+size_t put_double(unsigned char *out, double value);
+size_t put_u64(unsigned char *out, uint64_t value);
+uint64_t get_varint(Reader *in);
+long get_int(Reader *in);
+double get_double(Reader *in);
+uint64_t get_u64(Reader *in);
+
+size_t pack_state(const GameState *game, unsigned char *out);
+int unpack_state(GameState *game, const unsigned char *in, size_t len);
+uint64_t hash_bytes(const unsigned char *bytes, size_t len);
+
+#endif
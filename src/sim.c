@@ -0,0 +1,264 @@
+#include "sim.h"
+#include "prof.h"
+#include <sys/eventfd.h>
+
+
+// Hands the writer's back frame over as the newest, taking the spare (fresh or not) as the next back frame
+static void publish(FrameBuffer *buffer) {
+  buffer->back = atomic_exchange_explicit(&buffer->spare, buffer->back | FRAME_FRESH, memory_order_acq_rel) & ~FRAME_FRESH;
+}
+
+static void publish_frame(Sim *sim, long long time) {
+  Frame *frame = &sim->frames.frames[sim->frames.back];
+  copy_state(&frame->prev, &sim->prev);
+  copy_state(&frame->cur, sim->game);
+  frame->time = time;
+  publish(&sim->frames);
+}
+
+
+/* SIM MAIN
+ * The tick loop: sleeps until the next tick is due, then spends real time on whole physics ticks like the game
+ * always has, applying each key on the tick it was pressed in. A frame is published after every step
+ */
+
+static void *sim_main(void *arg) {
+  Sim *sim = arg;
+  GameState *game = sim->game;
+  long long accumulator = 0;
+  prof_lane = 1;
+
+  while (sched_wait(&sim->sched, sim->stop, true)) {
+    long long t = prof_begin();
+    if (sim->spec) { spec_poll(sim->spec); }
+    if (sim->net) {
+      net_poll(sim->net, game);
+      if (sim->net->lost) {
+        sim->lost = true;
+        break;
+      }
+    }
+    prof_end(PH_INPUT, t);
+
+    // After a long stall only catch up so many ticks, rather than freezing to simulate all of them
+    accumulator += sim->sched.delta;
+    if (accumulator > (long long)MAX_CATCHUP*TICK_NS) { accumulator = (long long)MAX_CATCHUP*TICK_NS; }
+
+    /* Real time has been simulated up to sim_time, and each tick stands for the next TICK_NS of it
+     * Every key goes in just before the tick its timestamp falls in, up to 7 a tick with any more waiting for the next
+     * Pausing a network match only stops this side, the other one waits for it
+     */
+    long long sim_time = sim->sched.last - accumulator;
+    t = prof_begin();
+    while (accumulator >= TICK_NS && !sim->pause) {
+      long long k = prof_begin();
+      int keys_pressed[8];
+      long long tick_end = sim_time + TICK_NS;
+      input_take(sim->input, tick_end, keys_pressed, 7);
+
+      for (int i = 0; keys_pressed[i] != ERR; i++) {
+        if (keys_pressed[i] == '`') { sim->timing_presses++; }
+        if (keys_pressed[i] == 'c') { sim->camera_presses++; }
+      }
+
+      if (sim->net) {
+        net_keys(sim->net, keys_pressed);
+        for (int i = 0; keys_pressed[i] != ERR; i++) {
+          if (keys_pressed[i] == '\n') { sim->pause = true; }
+        }
+      }
+      else {
+        if (sim->bot) { bot_keys(sim->bot, keys_pressed); }
+        if (sim->rec) { rec_keys(sim->rec, game, keys_pressed); }
+        handle_game_inputs(game, keys_pressed, &sim->pause);
+      }
+      prof_end(PH_GAME_INPUT, k);
+
+      copy_state(&sim->prev, game);
+      if (sim->net) {
+        // Too far ahead of the other side, time spent waiting for them isn't owed back afterwards
+        if (!net_advance(sim->net, game)) {
+          accumulator %= TICK_NS;
+          break;
+        }
+      }
+      else {
+        update_physics(game, 1);
+        if (sim->rec) { rec_tick(sim->rec, game); }
+        if (sim->ckpt && game->tick % CHECKPOINT_INTERVAL == 0) { ckpt_save(sim->ckpt, game); }
+        if (sim->bot && game->tick % BOT_EVERY == 0) { bot_post(sim->bot, game); }
+      }
+      accumulator -= TICK_NS;
+      sim_time = tick_end;
+    }
+    prof_end(PH_PHYSICS, t);
+
+    // The renderer and spectators both only hear about new physics states
+    if (game->tick != sim->published_tick) {
+      publish_frame(sim, sim_time);
+      if (sim->spec) {
+        t = prof_begin();
+        spec_publish(sim->spec, game);
+        prof_end(PH_SPECTATE, t);
+      }
+      sim->published_tick = game->tick;
+    }
+
+    // Over the network only a state built from real inputs on both sides can end the match
+    const GameState *result = sim->net ? net_confirmed_state(sim->net, game) : game;
+    if (check_winner(result)) {
+      sim->winner = check_winner(result);
+      if (result != game) { copy_state(game, result); }
+      sim->pause = true;
+    }
+    if (sim->pause) { break; }
+  }
+
+  atomic_store(&sim->running, false);
+  uint64_t one = 1;
+  write(sim->wake, &one, sizeof one);
+  return NULL;
+}
+
+
+// Sets up the tick scheduler and the two eventfds, once for the whole run
+int sim_init(Sim *sim) {
+  *sim = (Sim){0};
+  sim->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  sim->stop = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (sim->wake < 0 || sim->stop < 0) {
+    perror("eventfd");
+    return -1;
+  }
+  sched_init(&sim->sched, TICK_NS);
+  sim->frames = (FrameBuffer){ .back = 0, .front = 1, .spare = 2 };
+  return 0;
+}
+
+void sim_close(Sim *sim) {
+  sched_close(&sim->sched);
+  close(sim->wake);
+  close(sim->stop);
+}
+
+
+/* SIM START
+ * Starts ticking *game from now, set the pointers for whatever this match uses (NULL for anything it doesn't) first
+ * The first frame is published before the thread starts, so the renderer has the match from the start
+ */
+
+void sim_start(Sim *sim) {
+  uint64_t count;
+  read(sim->wake, &count, sizeof count);
+  read(sim->stop, &count, sizeof count);
+
+  sim->pause = sim->winner = sim->lost = false;
+  sim->sched.idle = true;
+  copy_state(&sim->prev, sim->game);
+  publish_frame(sim, now_ns());
+  sim->published_tick = sim->game->tick;
+
+  atomic_store(&sim->running, true);
+  pthread_create(&sim->thread, NULL, sim_main, sim);
+}
+
+// Asks the thread to stop if it hasn't already, and waits for it, after this the game is the caller's again
+void sim_stop(Sim *sim) {
+  uint64_t one = 1;
+  write(sim->stop, &one, sizeof one);
+  pthread_join(sim->thread, NULL);
+}
+
+
+// The newest frame the simulation has finished, which stays put until the next call
+const Frame *sim_frame(Sim *sim) {
+  FrameBuffer *buffer = &sim->frames;
+  if (atomic_load_explicit(&buffer->spare, memory_order_relaxed) & FRAME_FRESH) {
+    buffer->front = atomic_exchange_explicit(&buffer->spare, buffer->front, memory_order_acq_rel) & ~FRAME_FRESH;
+  }
+  return &buffer->frames[buffer->front];
+}
+
+// How far to draw from prev to cur at time now, cur is reached a tick after prev so this runs 0 to 1 across the tick
+double frame_alpha(const Frame *frame, long long now) {
+  double alpha = (double)(now - frame->time) / TICK_NS;
+  return alpha < 0 ? 0 : alpha > 1 ? 1 : alpha;
+}
+
+
+/* CHECK BLEND MAIN
+ * Usage: spacewar --check-blend [--fps N] [--ticks N]
+ * Runs a match on the simulation thread in real time with nobody at the keys, and takes frames from it N times a second
+ * (default 4*TICK_RATE) the way the screen does, blending them without drawing anything
+ * Fails unless most frames land part way between their two ticks, since drawing faster than TICK_RATE is pointless
+ * if they don't, and unless the ships actually move by part of a tick in the frames that do
+ */
+
+int check_blend_main(int argc, char *argv[]) {
+  int fps = 4*TICK_RATE;
+  long ticks = 2*TICK_RATE;
+  for (int i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "--fps") == 0 && i+1 < argc)        { fps = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--ticks") == 0 && i+1 < argc) { ticks = atol(argv[++i]); }
+  }
+  if (fps <= TICK_RATE || ticks < 1) {
+    fprintf(stderr, "--fps must be over %d to have frames between ticks, and --ticks at least 1\n", TICK_RATE);
+    return 1;
+  }
+
+  // Nothing is ever written to the pipe, the simulation just needs somewhere to take no keys from
+  int keys[2];
+  InputThread input;
+  if (pipe(keys) < 0) {
+    perror("pipe");
+    return 1;
+  }
+  if (input_start(&input, keys[0]) < 0) {
+    return 1;
+  }
+
+  static GameState game;
+  static Sim sim;
+  static GameState shown;
+  new_game(&game, 2);
+  if (sim_init(&sim) < 0) {
+    input_stop(&input);
+    return 1;
+  }
+  sim.game = &game;
+  sim.input = &input;
+  sim_start(&sim);
+
+  Scheduler sched;
+  sched_init(&sched, 1000000000/fps);
+  long frames = 0, between = 0, moved = 0;
+  double least = 1, most = 0;
+  while (sched_wait(&sched, -1, true)) {
+    const Frame *frame = sim_frame(&sim);
+    if (frame->cur.tick >= ticks) { break; }
+    if (frame->cur.tick == 0) { continue; }
+
+    double alpha = frame_alpha(frame, now_ns());
+    blend_states(&shown, &frame->prev, &frame->cur, alpha);
+    frames++;
+    if (alpha < least) { least = alpha; }
+    if (alpha > most)  { most = alpha; }
+    if (alpha > 0 && alpha < 1) {
+      between++;
+      const ObjectData *at = &shown.players[0].data, *from = &frame->prev.players[0].data, *to = &frame->cur.players[0].data;
+      if ((at->y != from->y || at->x != from->x) && (at->y != to->y || at->x != to->x)) { moved++; }
+    }
+  }
+
+  sim_stop(&sim);
+  sched_close(&sched);
+  sim_close(&sim);
+  input_stop(&input);
+  close(keys[0]);
+  close(keys[1]);
+
+  int ok = frames > 0 && between*2 > frames && moved*2 > between;
+  printf("frames %ld, alpha %.3f to %.3f, %ld between ticks, %ld of them drawn between positions: %s\n",
+         frames, least, most, between, moved, ok ? "ok" : "FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+#include "game.h"
+#include "input.h"
+#include "net.h"
+#include "bot.h"
+#include "replay.h"
+#include "checkpoint.h"
+#include "spectate.h"
+#include "sched.h"
+
+#ifndef SIM_H
+#define SIM_H
+
+// Physics catches up on at most a second of missed ticks, past that (a suspended process) the time is let go
+#define MAX_CATCHUP TICK_RATE
+
+// Set on FrameBuffer.spare while the spare frame is newer than the one the reader has
+#define FRAME_FRESH 4
+
+// Two consecutive physics states and the time the newer one reaches, everything needed to draw any moment in between
+typedef struct Frame {
+  GameState prev, cur;
+  long long time;
+} Frame;
+
+/* Triple buffer of frames from the simulation to the renderer, neither side ever waits for the other
+ * The writer fills its back frame then swaps it for the spare, the reader swaps its front frame for the spare
+ * whenever the spare is fresh. So the reader always has the newest whole frame, and nobody writes to it meanwhile
+ */
+typedef struct FrameBuffer {
+  Frame frames[3];
+  int back, front;
+  _Atomic int spare;
+} FrameBuffer;
+
+/* A match's physics on its own thread, ticking at TICK_RATE however long the screen takes to draw
+ * Everything the tick loop touches (the game, keys, the network, bot, replay, checkpoint and spectators) belongs
+ * to the thread while it runs, the rest of the game only sees finished frames through frames
+ * It stops when the match is paused or won, or the peer is lost, and says so through wake
+ * Keys that are for the screen (` and c) are counted for the render side to pick up
+ */
+typedef struct Sim {
+  pthread_t thread;
+  Scheduler sched;
+  int wake, stop;
+  GameState *game;
+  InputThread *input;
+  Net *net;
+  Bot *bot;
+  Recorder *rec;
+  Checkpoint *ckpt;
+  SpecServer *spec;
+  FrameBuffer frames;
+  GameState prev;
+  _Atomic int running;
+  _Atomic int timing_presses, camera_presses;
+  int pause, winner, lost;
+  int published_tick;
+} Sim;
+
+int sim_init(Sim *sim);
+void sim_close(Sim *sim);
+void sim_start(Sim *sim);
+void sim_stop(Sim *sim);
+const Frame *sim_frame(Sim *sim);
+double frame_alpha(const Frame *frame, long long now);
+int check_blend_main(int argc, char *argv[]);
+
+#endif
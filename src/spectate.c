@@ -0,0 +1,457 @@
+#include "spectate.h"
+#include "serial.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define SPEC_SNDBUF 16384
+#define FRAME_MAX_BYTES (64 + MAX_WELLS*2*5 + MAX_PLAYERS*SHIP_FIELDS*5 + MAX_BULLETS*(1 + SHOT_FIELDS*5))
+
+
+// Boils the game down to what a spectator sees, using the same truncation update_screen() does for cells
+static void to_wire(const GameState *game, WireFrame *frame) {
+  frame->tick = game->tick;
+  frame->arena_h = game->arena_h;
+  frame->arena_w = game->arena_w;
+  frame->torpedo_limit = game->torpedo_limit;
+  frame->n_wells = game->n_wells;
+  frame->n_ships = game->n_players;
+  frame->n_slots = game->n_bullets;
+
+  for (int i = 0; i < game->n_wells; i++) {
+    frame->wells[i][0] = game->wells[i].y / 2;
+    frame->wells[i][1] = game->wells[i].x;
+  }
+
+  for (int i = 0; i < game->n_players; i++) {
+    const Player *p = &game->players[i];
+    int *f = frame->ships[i];
+    const double trail[4][2] = { {p->data.y, p->data.x}, {p->data.y1, p->data.x1}, {p->data.y2, p->data.x2}, {p->data.y3, p->data.x3} };
+    f[SHIP_TYPE] = p->type;
+    for (int t = 0; t < 4; t++) {
+      f[SHIP_Y+t] = trail[t][0] / 2;
+      f[SHIP_X+t] = trail[t][1];
+    }
+    f[SHIP_VY] = lround(p->data.vely * 1e6);
+    f[SHIP_VX] = lround(p->data.velx * 1e6);
+    f[SHIP_TEMP] = lroundf(p->temp * 100);
+    f[SHIP_ACC] = p->acc;
+    f[SHIP_DIR] = p->dir;
+    f[SHIP_SCORE] = p->score;
+  }
+
+  for (int i = 0; i < game->n_bullets; i++) {
+    const Bullet *b = &game->bullets[i];
+    int *f = frame->shots[i];
+    frame->live[i] = b->type == BULLET;
+    if (!frame->live[i]) { continue; }
+    const double trail[4][2] = { {b->data.y, b->data.x}, {b->data.y1, b->data.x1}, {b->data.y2, b->data.x2}, {b->data.y3, b->data.x3} };
+    f[SHOT_OWNER] = b->owner;
+    f[SHOT_FUSE] = b->fuse;
+    for (int t = 0; t < 4; t++) {
+      f[SHOT_Y+t] = trail[t][0] / 2;
+      f[SHOT_X+t] = trail[t][1];
+    }
+  }
+}
+
+// Rebuilds a game update_screen() draws exactly as the original, positions land in the middle of their cells
+static void from_wire(const WireFrame *frame, GameState *game) {
+  game->tick = frame->tick;
+  game->arena_h = frame->arena_h;
+  game->arena_w = frame->arena_w;
+  game->torpedo_limit = frame->torpedo_limit;
+  game->n_wells = frame->n_wells;
+  game->n_players = frame->n_ships;
+  game->n_bullets = frame->n_slots;
+
+  for (int i = 0; i < frame->n_wells; i++) {
+    game->wells[i] = (BlackHole){ 2*frame->wells[i][0] + 1, frame->wells[i][1] + 0.5, 1 };
+  }
+
+  for (int i = 0; i < frame->n_ships; i++) {
+    const int *f = frame->ships[i];
+    Player *p = &game->players[i];
+    p->type = f[SHIP_TYPE];
+    double *trail[4][2] = { {&p->data.y, &p->data.x}, {&p->data.y1, &p->data.x1}, {&p->data.y2, &p->data.x2}, {&p->data.y3, &p->data.x3} };
+    for (int t = 0; t < 4; t++) {
+      *trail[t][0] = 2*f[SHIP_Y+t] + 1;
+      *trail[t][1] = f[SHIP_X+t] + 0.5;
+    }
+    p->data.vely = f[SHIP_VY] / 1e6;
+    p->data.velx = f[SHIP_VX] / 1e6;
+    p->temp = f[SHIP_TEMP] / 100.0f;
+    p->acc = f[SHIP_ACC];
+    p->dir = f[SHIP_DIR];
+    p->score = f[SHIP_SCORE];
+  }
+
+  for (int i = 0; i < frame->n_slots; i++) {
+    const int *f = frame->shots[i];
+    Bullet *b = &game->bullets[i];
+    if (!frame->live[i]) {
+      *b = err_bullet();
+      continue;
+    }
+    b->type = BULLET;
+    b->owner = f[SHOT_OWNER];
+    b->fuse = f[SHOT_FUSE];
+    double *trail[4][2] = { {&b->data.y, &b->data.x}, {&b->data.y1, &b->data.x1}, {&b->data.y2, &b->data.x2}, {&b->data.y3, &b->data.x3} };
+    for (int t = 0; t < 4; t++) {
+      *trail[t][0] = 2*f[SHOT_Y+t] + 1;
+      *trail[t][1] = f[SHOT_X+t] + 0.5;
+    }
+  }
+  torpedo_reindex(game);
+}
+
+
+/* ENCODE FRAME
+ * Writes a frame as zigzag varint differences from base, field by field, so anything that didn't move is one byte
+ * A keyframe has no base and is encoded against zero. Entries base doesn't have are encoded against zero too
+ */
+
+static size_t encode_frame(const WireFrame *frame, const WireFrame *base, unsigned char *out) {
+  static const int zero[WIRE_FIELDS];
+  size_t len = 0;
+  len += put_varint(out+len, base == NULL);
+  len += put_varint(out+len, frame->tick);
+  len += put_varint(out+len, frame->arena_h);
+  len += put_varint(out+len, frame->arena_w);
+  len += put_varint(out+len, frame->torpedo_limit);
+  len += put_varint(out+len, frame->n_wells);
+  len += put_varint(out+len, frame->n_ships);
+  len += put_varint(out+len, frame->n_slots);
+
+  for (int i = 0; i < frame->n_wells; i++) {
+    const int *b = base && i < base->n_wells ? base->wells[i] : zero;
+    len += put_int(out+len, (long)frame->wells[i][0] - b[0]);
+    len += put_int(out+len, (long)frame->wells[i][1] - b[1]);
+  }
+
+  for (int i = 0; i < frame->n_ships; i++) {
+    const int *b = base && i < base->n_ships ? base->ships[i] : zero;
+    for (int f = 0; f < SHIP_FIELDS; f++) {
+      len += put_int(out+len, (long)frame->ships[i][f] - b[f]);
+    }
+  }
+
+  for (int i = 0; i < frame->n_slots; i++) {
+    len += put_varint(out+len, frame->live[i]);
+    if (!frame->live[i]) { continue; }
+    const int *b = base && i < base->n_slots && base->live[i] ? base->shots[i] : zero;
+    for (int f = 0; f < SHOT_FIELDS; f++) {
+      len += put_int(out+len, (long)frame->shots[i][f] - b[f]);
+    }
+  }
+
+  return len;
+}
+
+// The reverse of encode_frame(), decoding in place over the previous frame, returns -1 if the frame is malformed
+static int decode_frame(WireFrame *frame, Reader *in, int *keyframe) {
+  static const int zero[WIRE_FIELDS];
+  *keyframe = get_varint(in);
+  int tick = get_varint(in);
+  int arena_h = get_varint(in);
+  int arena_w = get_varint(in);
+  int torpedo_limit = get_varint(in);
+  int n_wells = get_varint(in);
+  int n_ships = get_varint(in);
+  int n_slots = get_varint(in);
+  if (in->bad || n_wells > MAX_WELLS || n_ships > MAX_PLAYERS || n_slots > MAX_BULLETS
+      || arena_h < 1 || arena_h > 2*MAX_WORLD || arena_w < 1 || arena_w > MAX_WORLD
+      || torpedo_limit < 1 || torpedo_limit > MAX_BULLETS) {
+    return -1;
+  }
+
+  for (int i = 0; i < n_wells; i++) {
+    const int *b = !*keyframe && i < frame->n_wells ? frame->wells[i] : zero;
+    frame->wells[i][0] = b[0] + get_int(in);
+    frame->wells[i][1] = b[1] + get_int(in);
+  }
+
+  for (int i = 0; i < n_ships; i++) {
+    int base[SHIP_FIELDS];
+    memcpy(base, !*keyframe && i < frame->n_ships ? frame->ships[i] : zero, sizeof base);
+    for (int f = 0; f < SHIP_FIELDS; f++) {
+      frame->ships[i][f] = base[f] + get_int(in);
+    }
+  }
+
+  for (int i = 0; i < n_slots; i++) {
+    int was_live = !*keyframe && i < frame->n_slots && frame->live[i];
+    frame->live[i] = get_varint(in);
+    if (!frame->live[i]) { continue; }
+    int base[SHOT_FIELDS];
+    memcpy(base, was_live ? frame->shots[i] : zero, sizeof base);
+    for (int f = 0; f < SHOT_FIELDS; f++) {
+      frame->shots[i][f] = base[f] + get_int(in);
+    }
+  }
+
+  frame->tick = tick;
+  frame->arena_h = arena_h;
+  frame->arena_w = arena_w;
+  frame->torpedo_limit = torpedo_limit;
+  frame->n_wells = n_wells;
+  frame->n_ships = n_ships;
+  frame->n_slots = n_slots;
+  return in->bad || in->pos != in->end ? -1 : 0;
+}
+
+
+/* SPEC LISTEN
+ * Opens a Unix socket at path for spectators to connect to, replacing anything left there by an earlier run
+ * Returns -1 and says why if it can't
+ */
+
+int spec_listen(SpecServer *server, const char *path) {
+  memset(server, 0, sizeof *server);
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof addr.sun_path) {
+    fprintf(stderr, "%s: socket path too long\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  strcpy(server->path, path);
+
+  unlink(path);
+  server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (server->listen_fd < 0 || bind(server->listen_fd, (struct sockaddr *)&addr, sizeof addr) < 0 || listen(server->listen_fd, 16) < 0) {
+    perror(path);
+    if (server->listen_fd >= 0) { close(server->listen_fd); }
+    return -1;
+  }
+
+  server->prev = malloc(sizeof(WireFrame));
+  server->cur = malloc(sizeof(WireFrame));
+  server->scratch = malloc(FRAME_MAX_BYTES + 10);
+  server->force_key = true;
+  return 0;
+}
+
+static void unref(SpecFrame *frame) {
+  if (--frame->refs == 0) {
+    free(frame);
+  }
+}
+
+static void drop_client(SpecServer *server, int c) {
+  Spectator *s = &server->clients[c];
+  for (int i = 0; i < s->count; i++) {
+    unref(s->queue[(s->head + i) % SPEC_QUEUE]);
+  }
+  close(s->fd);
+  server->clients[c] = server->clients[--server->n_clients];
+}
+
+// Writes as much of a spectator's queue as its socket takes right now, returns -1 if it has gone away
+static int flush_client(Spectator *s) {
+  while (s->count > 0) {
+    SpecFrame *frame = s->queue[s->head];
+    ssize_t n = send(s->fd, frame->bytes + s->sent, frame->len - s->sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    }
+    s->sent += n;
+    if (s->sent == frame->len) {
+      unref(frame);
+      s->head = (s->head + 1) % SPEC_QUEUE;
+      s->count--;
+      s->sent = 0;
+    }
+  }
+  return 0;
+}
+
+// Drops everything queued for a spectator except a frame it is halfway through, then it waits for a keyframe
+static void skip_client(SpecServer *server, Spectator *s) {
+  int keep = s->sent > 0;
+  for (int i = keep; i < s->count; i++) {
+    unref(s->queue[(s->head + i) % SPEC_QUEUE]);
+  }
+  s->count = keep;
+  s->waiting = true;
+  server->force_key = true;
+  server->skips++;
+}
+
+
+// Takes new spectators and sends what the old ones have room for, call it every time round the game loop
+void spec_poll(SpecServer *server) {
+  int fd;
+  while ((fd = accept(server->listen_fd, NULL, NULL)) >= 0) {
+    if (server->n_clients == MAX_SPECTATORS) {
+      close(fd);
+      continue;
+    }
+    // A small socket buffer, so a stalled spectator fills its queue and skips ahead instead of lagging seconds behind
+    int buffer = SPEC_SNDBUF;
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof buffer);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    server->clients[server->n_clients++] = (Spectator){ .fd = fd, .waiting = true };
+    server->force_key = true;
+  }
+
+  for (int c = server->n_clients-1; c >= 0; c--) {
+    if (flush_client(&server->clients[c]) < 0) {
+      drop_client(server, c);
+    }
+  }
+}
+
+
+/* SPEC PUBLISH
+ * Encodes the game once and queues the same buffer for every spectator that can take it
+ * Spectators waiting for a keyframe skip deltas, and a full queue is skipped rather than waited on
+ */
+
+void spec_publish(SpecServer *server, const GameState *game) {
+  spec_poll(server);
+
+  if (server->n_clients == 0) {
+    server->force_key = true;
+    return;
+  }
+
+  int keyframe = server->force_key || server->since_key >= KEYFRAME_EVERY;
+  to_wire(game, server->cur);
+  size_t payload = encode_frame(server->cur, keyframe ? NULL : server->prev, server->scratch + 10);
+  size_t prefix = put_varint(server->scratch, payload);
+
+  SpecFrame *frame = malloc(sizeof(SpecFrame) + prefix + payload);
+  frame->refs = 0;
+  frame->len = prefix + payload;
+  memcpy(frame->bytes, server->scratch, prefix);
+  memcpy(frame->bytes + prefix, server->scratch + 10, payload);
+
+  WireFrame *swap = server->prev;
+  server->prev = server->cur;
+  server->cur = swap;
+  server->since_key = keyframe ? 0 : server->since_key+1;
+  server->force_key = false;
+  server->frames++;
+  server->keyframes += keyframe;
+
+  for (int c = 0; c < server->n_clients; c++) {
+    Spectator *s = &server->clients[c];
+    if (s->count == SPEC_QUEUE) {
+      skip_client(server, s);
+    }
+    if (s->waiting && !keyframe) {
+      continue;
+    }
+    s->queue[(s->head + s->count) % SPEC_QUEUE] = frame;
+    s->count++;
+    s->waiting = false;
+    frame->refs++;
+    server->bytes += frame->len;
+  }
+
+  if (frame->refs == 0) {
+    free(frame);
+  }
+
+  for (int c = server->n_clients-1; c >= 0; c--) {
+    if (flush_client(&server->clients[c]) < 0) {
+      drop_client(server, c);
+    }
+  }
+}
+
+void spec_close(SpecServer *server) {
+  while (server->n_clients > 0) {
+    drop_client(server, server->n_clients-1);
+  }
+  close(server->listen_fd);
+  unlink(server->path);
+  free(server->prev);
+  free(server->cur);
+  free(server->scratch);
+}
+
+void spec_report(SpecServer *server, FILE *out) {
+  fprintf(out, "spectator frames %ld (%ld keyframes), %.1f bytes per frame sent, %ld skips\n", server->frames,
+          server->keyframes, server->frames ? (double)server->bytes / server->frames : 0.0, server->skips);
+}
+
+
+int spec_connect(SpecClient *client, const char *path) {
+  memset(client, 0, sizeof *client);
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof addr.sun_path) {
+    fprintf(stderr, "%s: socket path too long\n", path);
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  client->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (client->fd < 0 || connect(client->fd, (struct sockaddr *)&addr, sizeof addr) < 0) {
+    perror(path);
+    if (client->fd >= 0) { close(client->fd); }
+    return -1;
+  }
+  fcntl(client->fd, F_SETFL, fcntl(client->fd, F_GETFL) | O_NONBLOCK);
+
+  client->cap = 2 * (FRAME_MAX_BYTES + 10);
+  client->buf = malloc(client->cap);
+  client->frame = calloc(1, sizeof(WireFrame));
+  return 0;
+}
+
+
+/* SPEC RECEIVE
+ * Reads whatever the server has sent and decodes every whole frame in it, leaving game as of the latest one
+ * Returns 1 if game changed, 0 if there was nothing new, -1 once the server has gone or sent something broken
+ */
+
+int spec_receive(SpecClient *client, GameState *game) {
+  int eof = false;
+  while (client->len < client->cap) {
+    ssize_t n = recv(client->fd, client->buf + client->len, client->cap - client->len, 0);
+    if (n > 0) { client->len += n; continue; }
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) { eof = true; }
+    break;
+  }
+
+  int changed = false;
+  size_t used = 0;
+  while (used < client->len) {
+    Reader in = { client->buf + used, client->buf + client->len, false };
+    uint64_t len = get_varint(&in);
+    if (in.bad || len > (uint64_t)(in.end - in.pos)) {
+      if (len > FRAME_MAX_BYTES) { return -1; }
+      break;
+    }
+
+    Reader payload = { in.pos, in.pos + len, false };
+    used = in.pos + len - client->buf;
+
+    // Until the first keyframe there is nothing to apply deltas to
+    int keyframe = payload.end > payload.pos && payload.pos[0] == 1;
+    if (!keyframe && !client->have_key) {
+      continue;
+    }
+    if (decode_frame(client->frame, &payload, &keyframe) < 0) {
+      return -1;
+    }
+    client->have_key = true;
+    changed = true;
+  }
+
+  memmove(client->buf, client->buf + used, client->len - used);
+  client->len -= used;
+
+  if (changed) {
+    from_wire(client->frame, game);
+  }
+  return eof && !changed ? -1 : changed;
+}
+
+void spec_disconnect(SpecClient *client) {
+  close(client->fd);
+  free(client->buf);
+  free(client->frame);
+}
@@ -0,0 +1,80 @@
+#include "game.h"
+
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+// A keyframe at least once a second, and straight away whenever a spectator joins or has to skip ahead
+#define KEYFRAME_EVERY 50
+// Frames a spectator can fall behind by before the rest of its queue is dropped
+#define SPEC_QUEUE 32
+#define MAX_SPECTATORS 64
+
+// What update_screen() needs of each ship and torpedo, as whole numbers: trail cells, velocity in millionths,
+// temperature in hundredths. Frames are sent as the difference from the last frame, field by field
+enum ShipField { SHIP_TYPE, SHIP_Y, SHIP_X = SHIP_Y+4, SHIP_VY = SHIP_X+4, SHIP_VX, SHIP_TEMP, SHIP_ACC, SHIP_DIR, SHIP_SCORE, SHIP_FIELDS };
+enum ShotField { SHOT_OWNER, SHOT_FUSE, SHOT_Y, SHOT_X = SHOT_Y+4, SHOT_FIELDS = SHOT_X+4 };
+
+// Room for either kind of entry, for the zeroes a keyframe is encoded against
+#define WIRE_FIELDS ((int)SHIP_FIELDS > (int)SHOT_FIELDS ? (int)SHIP_FIELDS : (int)SHOT_FIELDS)
+
+typedef struct WireFrame {
+  int tick;
+  int arena_h, arena_w;
+  int torpedo_limit;
+  int n_wells, n_ships, n_slots;
+  int wells[MAX_WELLS][2];
+  int ships[MAX_PLAYERS][SHIP_FIELDS];
+  int live[MAX_BULLETS];
+  int shots[MAX_BULLETS][SHOT_FIELDS];
+} WireFrame;
+
+// One encoded frame, shared by every spectator it is queued for and freed by whoever sends it last
+typedef struct SpecFrame {
+  int refs;
+  size_t len;
+  unsigned char bytes[];
+} SpecFrame;
+
+// sent is how far into the frame at the head of the queue the socket has got
+typedef struct Spectator {
+  int fd;
+  int waiting;
+  SpecFrame *queue[SPEC_QUEUE];
+  int head, count;
+  size_t sent;
+} Spectator;
+
+/* Streams the game to any number of spectators on a Unix socket, from the one simulation
+ * Each frame is encoded once, and spectators are only ever written to without blocking. One that falls SPEC_QUEUE
+ * frames behind loses its queue and waits for the next keyframe, which is then sent straight away
+ */
+typedef struct SpecServer {
+  int listen_fd;
+  char path[108];
+  Spectator clients[MAX_SPECTATORS];
+  int n_clients;
+  WireFrame *prev, *cur;
+  int since_key, force_key;
+  unsigned char *scratch;
+  long frames, keyframes, skips, bytes;
+} SpecServer;
+
+typedef struct SpecClient {
+  int fd;
+  unsigned char *buf;
+  size_t len, cap;
+  WireFrame *frame;
+  int have_key;
+} SpecClient;
+
+int spec_listen(SpecServer *server, const char *path);
+void spec_poll(SpecServer *server);
+void spec_publish(SpecServer *server, const GameState *game);
+void spec_close(SpecServer *server);
+void spec_report(SpecServer *server, FILE *out);
+
+int spec_connect(SpecClient *client, const char *path);
+int spec_receive(SpecClient *client, GameState *game);
+void spec_disconnect(SpecClient *client);
+
+#endif
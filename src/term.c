@@ -0,0 +1,244 @@
+#include "term.h"
+#include <sys/ioctl.h>
+
+// Worst case bytes for one cell: a cursor move, a colour change and a four byte UTF-8 glyph
+#define CELL_BYTES 64
+
+
+/* The colour pairs from setup(), as foreground then background escapes
+ * The RGB values are the init_color() ones scaled from 0-1000 to 0-255, pair 0 is the terminal's own colours
+ */
+static const char *pair_sgr[] = {
+  "\x1b[0m",
+  "\x1b[38;2;102;217;249;48;2;13;13;13m",
+  "\x1b[38;2;64;102;38;48;2;13;13;13m",
+  "\x1b[38;2;32;45;26;48;2;13;13;13m",
+};
+
+static void emit(Term *term, const char *bytes, size_t len) {
+  memcpy(term->out + term->out_len, bytes, len);
+  term->out_len += len;
+}
+
+static void emit_str(Term *term, const char *str) {
+  emit(term, str, strlen(str));
+}
+
+static void emit_int(Term *term, int n) {
+  char digits[12];
+  int len = 0;
+  do { digits[len++] = '0' + n%10; n /= 10; } while (n);
+  while (len) { term->out[term->out_len++] = digits[--len]; }
+}
+
+// Hand rolled UTF-8 encoding, so a glyph never goes anywhere near a format string
+static void emit_glyph(Term *term, wchar_t ch) {
+  unsigned c = ch ? ch : L' ';
+  char *o = term->out + term->out_len;
+  if (c < 0x80)         { o[0] = c;                                                                              term->out_len += 1; }
+  else if (c < 0x800)   { o[0] = 0xC0 | c>>6;  o[1] = 0x80 | (c & 0x3F);                                         term->out_len += 2; }
+  else if (c < 0x10000) { o[0] = 0xE0 | c>>12; o[1] = 0x80 | (c>>6 & 0x3F); o[2] = 0x80 | (c & 0x3F);            term->out_len += 3; }
+  else                  { o[0] = 0xF0 | c>>18; o[1] = 0x80 | (c>>12 & 0x3F); o[2] = 0x80 | (c>>6 & 0x3F); o[3] = 0x80 | (c & 0x3F); term->out_len += 4; }
+}
+
+static void write_all(int fd, const char *bytes, size_t len) {
+  while (len > 0) {
+    ssize_t done = write(fd, bytes, len);
+    if (done <= 0) { return; }
+    bytes += done;
+    len -= done;
+  }
+}
+
+
+// (Re)allocates the cell grids and output buffer for a screen of h x w, the next present redraws everything
+void term_resize(Term *term, int h, int w) {
+  term->h = h;
+  term->w = w;
+  term->cells = realloc(term->cells, h*w * sizeof(Cell));
+  term->shown = realloc(term->shown, h*w * sizeof(Cell));
+  term->out_cap = (size_t)h*w * CELL_BYTES + 64;
+  term->out = realloc(term->out, term->out_cap);
+
+  for (int i = 0; i < h*w; i++) {
+    term->cells[i] = (Cell){L' ', 0};
+  }
+  term->full = true;
+}
+
+
+/* TERM OPEN
+ * Switches the terminal to unbuffered, unechoed input and the alternate screen, like setup() does through ncurses
+ * If out_fd isn't a terminal it still works as an in-memory 80x24 screen, returns -1 if it couldn't be set up at all
+ */
+
+int term_open(Term *term, int out_fd, int in_fd) {
+  *term = (Term){0};
+  term->out_fd = out_fd;
+  term->in_fd = in_fd;
+
+  struct winsize size;
+  if (ioctl(out_fd, TIOCGWINSZ, &size) < 0 || size.ws_row == 0) {
+    size.ws_row = 24;
+    size.ws_col = 80;
+  }
+  term_resize(term, size.ws_row, size.ws_col);
+  if (!term->cells || !term->out) {
+    return -1;
+  }
+
+  if (in_fd >= 0 && tcgetattr(in_fd, &term->saved) == 0) {
+    struct termios raw = term->saved;
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(in_fd, TCSANOW, &raw);
+  }
+  else {
+    term->in_fd = -1;
+  }
+
+  const char *start = "\x1b[?1049h\x1b[?25l\x1b[0m\x1b[2J";
+  write_all(out_fd, start, strlen(start));
+  return 0;
+}
+
+// A screen of h x w that only exists in memory, whoever owns it takes each frame's changes with term_diff()
+int term_open_memory(Term *term, int h, int w) {
+  *term = (Term){0};
+  term->out_fd = term->in_fd = -1;
+  term_resize(term, h, w);
+  return term->cells && term->out ? 0 : -1;
+}
+
+void term_close(Term *term) {
+  if (term->out_fd >= 0) {
+    const char *end = "\x1b[0m\x1b[?25h\x1b[?1049l";
+    write_all(term->out_fd, end, strlen(end));
+  }
+  if (term->in_fd >= 0) {
+    tcsetattr(term->in_fd, TCSANOW, &term->saved);
+  }
+
+  free(term->cells);
+  free(term->shown);
+  free(term->out);
+}
+
+// Sets one cell of the next frame, anything off screen is dropped
+void term_put(Term *term, int y, int x, wchar_t ch, int colour) {
+  if (y < 0 || y >= term->h || x < 0 || x >= term->w) {
+    return;
+  }
+  term->cells[y * term->w + x] = (Cell){ch, colour};
+}
+
+// Forgets what the terminal is showing, so the next present sends every cell
+void term_redraw(Term *term) {
+  term->full = true;
+}
+
+
+/* TERM DIFF
+ * Builds the escape stream that turns the shown frame into the new one, and returns its length
+ * Cursor moves are only sent when the next changed cell isn't straight after the last, colours only when they change
+ */
+
+size_t term_diff(Term *term) {
+  term->out_len = 0;
+  int cursor = -1;
+  int colour = -1;
+
+  if (term->full) {
+    emit_str(term, "\x1b[0m\x1b[2J");
+  }
+
+  for (int i = 0; i < term->h * term->w; i++) {
+    Cell c = term->cells[i];
+    if (!term->full && c.ch == term->shown[i].ch && c.colour == term->shown[i].colour) {
+      continue;
+    }
+
+    if (cursor != i) {
+      emit_str(term, "\x1b[");
+      emit_int(term, i / term->w + 1);
+      emit_str(term, ";");
+      emit_int(term, i % term->w + 1);
+      emit_str(term, "H");
+    }
+    if (colour != c.colour) {
+      emit_str(term, pair_sgr[c.colour >= 0 && c.colour <= 3 ? c.colour : 0]);
+      colour = c.colour;
+    }
+
+    emit_glyph(term, c.ch);
+    term->shown[i] = c;
+    cursor = i+1;
+  }
+
+  term->full = false;
+  return term->out_len;
+}
+
+// Sends this frame's changes to the terminal, in one write() unless the terminal only takes part of it
+// An in-memory screen has nowhere to send them, so they build up for its next term_diff()
+void term_present(Term *term) {
+  if (term->out_fd >= 0 && term_diff(term)) {
+    write_all(term->out_fd, term->out, term->out_len);
+  }
+}
+
+
+/* DECODE KEYS
+ * Turns raw terminal bytes into key codes, arrows (ESC [ X or ESC O X) become the same KEY_ codes ncurses gives
+ * Decoded bytes are taken off the front of the buffer, an escape sequence that hasn't all arrived is left for next time
+ */
+
+int decode_keys(unsigned char *in, int *len, int keys[], int max) {
+  int n = 0;
+  int i = 0;
+  while (i < *len && n < max) {
+    unsigned char c = in[i];
+
+    if (c != 0x1b) {
+      keys[n++] = c == '\r' ? '\n' : c;
+      i++;
+      continue;
+    }
+
+    // ESC [ X or ESC O X, wait for the rest if it hasn't all arrived
+    if (i+2 >= *len) {
+      if (i+1 < *len && in[i+1] != '[' && in[i+1] != 'O') { i++; continue; }
+      break;
+    }
+    if (in[i+1] != '[' && in[i+1] != 'O') {
+      i++;
+      continue;
+    }
+
+    switch (in[i+2]) {
+      case 'A': keys[n++] = KEY_UP;    break;
+      case 'B': keys[n++] = KEY_DOWN;  break;
+      case 'C': keys[n++] = KEY_RIGHT; break;
+      case 'D': keys[n++] = KEY_LEFT;  break;
+    }
+    i += 3;
+  }
+
+  memmove(in, in + i, *len - i);
+  *len -= i;
+  return n;
+}
+
+// Reads whatever is waiting on the input and decodes up to max key presses into keys[], returns how many there were
+int term_read_keys(Term *term, int keys[], int max) {
+  if (term->in_fd < 0) {
+    return 0;
+  }
+
+  ssize_t got = read(term->in_fd, term->in + term->in_len, sizeof term->in - term->in_len);
+  if (got > 0) {
+    term->in_len += got;
+  }
+  return decode_keys(term->in, &term->in_len, keys, max);
+}
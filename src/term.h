@@ -0,0 +1,40 @@
+#include "utils.h"
+#include <termios.h>
+
+#ifndef TERM_H
+#define TERM_H
+
+typedef struct Cell {
+  wchar_t ch;
+  short colour;
+} Cell;
+
+/* Direct ANSI terminal backend, used instead of ncurses with --ansi
+ * cells is the frame being drawn and shown is what the terminal has, term_present() sends the difference as one
+ * escape stream built in a buffer allocated up front, with a single write()
+ * Colours are the same three pairs setup() gives ncurses, sent as 24 bit colour
+ */
+typedef struct Term {
+  int h, w;
+  int out_fd, in_fd;
+  int full;
+  Cell *cells, *shown;
+  char *out;
+  size_t out_len, out_cap;
+  unsigned char in[64];
+  int in_len;
+  struct termios saved;
+} Term;
+
+int term_open(Term *term, int out_fd, int in_fd);
+int term_open_memory(Term *term, int h, int w);
+void term_close(Term *term);
+void term_resize(Term *term, int h, int w);
+void term_put(Term *term, int y, int x, wchar_t ch, int colour);
+void term_redraw(Term *term);
+size_t term_diff(Term *term);
+void term_present(Term *term);
+int decode_keys(unsigned char *in, int *len, int keys[], int max);
+int term_read_keys(Term *term, int keys[], int max);
+
+#endif
@@ -27,19 +27,19 @@ ObjectData new_objectdata(double y, double x) {
   return (ObjectData){y, x, y, x, y, x, y, x, 0, 0};
 }
 
-// Constructor function for Players
+// Constructor function for Players, where they start is also where they respawn
 Player new_player(enum Type type, double y, double x, int dir, int score) {
-  return (Player){type, new_objectdata(y, x), 0, 0, dir, score};
+  return (Player){type, new_objectdata(y, x), 0, 0, dir, score, y, x, dir, 0, NO_TORPEDO};
 }
 
 // Constructor function for Bullets
-Bullet new_bullet(double y, double x) {
-  return (Bullet){BULLET, new_objectdata(y, x), INT_MAX};
+Bullet new_bullet(double y, double x, int owner) {
+  return (Bullet){BULLET, new_objectdata(y, x), BULLET_FUSE, owner, -1, 0};
 }
 
 // Blank Bullet with ERR type
 Bullet err_bullet() {
-  return (Bullet){ERR, new_objectdata(0, 0), 0};
+  return (Bullet){ERR, new_objectdata(0, 0), 0, -1, -1, 0};
 }
 
 double total_dist_squared(double dy, double dx) {
@@ -68,8 +68,8 @@ double thrust_vector(int object_dir, enum Axis axis) {
   double direction;
 
   switch (object_dir%2) {
-    case 0: magnitude = 1;         break;
-    case 1: magnitude = 1/sqrt(2); break;
+    case 0:  magnitude = 1;         break;
+    default: magnitude = 1/sqrt(2); break;
   }
   
   if (axis == X) {
@@ -88,8 +88,7 @@ double thrust_vector(int object_dir, enum Axis axis) {
     case SW:
       direction = 1;
       break;
-    case E:
-    case W:
+    default:
       direction = 0;
       break;
   }
@@ -97,6 +96,14 @@ double thrust_vector(int object_dir, enum Axis axis) {
   return magnitude * direction;
 }
 
+// Small fast PRNG (splitmix64), the state lives wherever it's needed so separate games and threads never share one
+uint64_t next_random(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
 // Returns the character that represents each type of GameObject 
 wchar_t charoftype(enum Type type) {
   switch (type) {
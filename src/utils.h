@@ -1,8 +1,14 @@
+// Wide character curses functions (cchar_t, mvwadd_wch), we always link ncursesw
+#define NCURSES_WIDECHAR 1
+
 #include <curses.h>
 #include <locale.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <limits.h>
+#include <stdint.h>
 #include <time.h>
 #include <math.h>
 
@@ -17,9 +23,26 @@
   #define M_PI 3.14159265358979323846
 #endif
 
+// Physics always advances in whole ticks of this size, so results don't depend on frame timing
+#define TICK_RATE 50
+#define TICK_NS (1000000000/TICK_RATE)
+#define TICK_D ((double)TICK_NS/33333333.3)
+
+// Torpedo lifetime in ticks, roughly the 2.1 seconds it used to be in nanoseconds
+#define BULLET_FUSE (TICK_RATE*2147/1000)
+
+// Capacity of the entity tables in GameState
+#define MAX_PLAYERS 64
+#define MAX_BULLETS 4096
+#define MAX_WELLS 64
+
+// Largest arena either way in terminal cells, which keeps fixed point distances well inside 64 bits
+#define MAX_WORLD 4096
+
 enum Type { BLACKHOLE, PLAYER1, PLAYER2, BULLET };
 enum Dir  { N, NE, E, SE, S, SW, W, NW };
 enum Axis { Y, X };
+enum Action { ENGINE, LEFT, RIGHT, FIRE };
 
 typedef struct ObjectData {
   double y, x;
@@ -30,26 +53,58 @@ typedef struct ObjectData {
 } ObjectData;
 
 typedef struct BlackHole {
-  double y, x;
+  double y, x, mass;
 } BlackHole;
 
+// A torpedo's slot in the low 16 bits and the slot's generation when it was fired above them, 0 is no torpedo
+typedef uint32_t TorpedoRef;
+#define NO_TORPEDO 0
+
+// torpedoes is how many it has in flight, and torpedo the newest of them (if that one is still going)
 typedef struct Player {
   enum Type type;
   ObjectData data;
   float temp;
   int acc, dir, score;
+  double spawn_y, spawn_x;
+  int spawn_dir;
+  int torpedoes;
+  TorpedoRef torpedo;
 } Player;
 
+/* link is the slot's place in GameState.alive while it holds a torpedo, and the next free slot (or -1) while it doesn't
+ * gen goes up each time the slot is freed, so a TorpedoRef to what used to be there no longer matches
+ */
 typedef struct Bullet {
   enum Type type;
   ObjectData data;
-  int fuse;
+  int fuse, owner;
+  int link;
+  unsigned gen;
 } Bullet;
 
+/* Everything needed to step a match
+ * Torpedoes come from a fixed pool: slots below n_bullets have been used, the free ones are chained from free_bullet
+ * through their links, and alive holds the n_alive live ones packed together, in the order physics visits them
+ * Slots at or above n_bullets are never looked at. A ship can have torpedo_limit torpedoes in flight at once
+ * ship_mass above 0 makes ships attract each other, theta is the Barnes-Hut opening angle for big gravity fields
+ * fixed_point matches move everything in Q16.16 integers, and keep every position and velocity on that grid
+ * The arena starts at (ARENA_TOP, ARENA_LEFT) and is arena_h by arena_w physics units, wrapping at the edges
+ */
 typedef struct GameState {
-  BlackHole bh;
-  Player players[2];
-  Bullet bullets[2];
+  int n_wells, n_players, n_bullets;
+  int n_alive, free_bullet;
+  int torpedo_limit;
+  BlackHole wells[MAX_WELLS];
+  Player players[MAX_PLAYERS];
+  Bullet bullets[MAX_BULLETS];
+  int alive[MAX_BULLETS];
+  double ship_mass, theta;
+  int torpedo_gravity;
+  int fixed_point;
+  int arena_h, arena_w;
+  int tick;
+  uint64_t rng;
 } GameState;
 
 void wcolour(WINDOW *win, int col);
@@ -57,12 +112,13 @@ void colour(int col);
 int get_delta(struct timespec *start, struct timespec *end);
 ObjectData new_objectdata(double y, double x);
 Player new_player(enum Type type, double y, double x, int dir, int score);
-Bullet new_bullet(double y, double x);
+Bullet new_bullet(double y, double x, int owner);
 Bullet err_bullet();
 double total_dist_squared(double dy, double dx);
 double total_vel(ObjectData object);
 void shift_trails(ObjectData *data);
 double thrust_vector(int object_dir, enum Axis axis);
+uint64_t next_random(uint64_t *state);
 wchar_t charoftype(enum Type type);
 wchar_t charofdir(enum Dir dir);
 